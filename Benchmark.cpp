@@ -0,0 +1,328 @@
+#include "PixelKernels.h"
+#include "CodepointTable.h"
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+
+using namespace std;
+using namespace SubPixelFonts;
+
+// Measures the pixel conversion functions against the plain loops they replaced,
+// and glyph lookups in CodepointTable against the std::map it replaced.
+// Build with 'make bench'.
+
+
+// The loop previously used in Glyph::Glyph
+static void reference_rgb_to_rgba(unsigned char* dst, const unsigned char* src, unsigned int width, unsigned int height, int pitch) {
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			dst[0] = src[x * 3 + 0];
+			dst[1] = src[x * 3 + 1];
+			dst[2] = src[x * 3 + 2];
+			dst[3] = 255;
+			dst += 4;
+		}
+		src += pitch;
+	}
+}
+
+static void reference_bgr_to_rgba(unsigned char* dst, const unsigned char* src, unsigned int width, unsigned int height, int pitch) {
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			dst[0] = src[x * 3 + 2];
+			dst[1] = src[x * 3 + 1];
+			dst[2] = src[x * 3 + 0];
+			dst[3] = 255;
+			dst += 4;
+		}
+		src += pitch;
+	}
+}
+
+static void reference_rgba_to_rgb(unsigned char* dst, const unsigned char* src, unsigned int width, unsigned int height) {
+	for (unsigned int i = 0; i < width * height; i++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst += 3;
+		src += 4;
+	}
+}
+
+static void reference_gray_to_rgba(unsigned char* dst, const unsigned char* src, unsigned int width, unsigned int height) {
+	for (unsigned int i = 0; i < width * height; i++) {
+		dst[0] = dst[1] = dst[2] = src[i];
+		dst[3] = 255;
+		dst += 4;
+	}
+}
+
+// The loop previously used in the TextureAtlas constructor
+static void reference_blit(unsigned char* dst, const unsigned char* src, unsigned int atlas_width, unsigned int glyph_width, unsigned int glyph_height) {
+	for (unsigned y = 0; y < glyph_height; y++) {
+		unsigned dst_idx = (y * atlas_width) * 4;
+		memcpy(&dst[dst_idx], &src[y * glyph_width * 4], glyph_width * 4);
+	}
+}
+
+static double calls_per_second(function<void()> const& f) {
+	f(); // Warm up
+
+	unsigned int iterations = 0;
+	auto start = chrono::steady_clock::now();
+	chrono::duration<double> elapsed;
+	do {
+		for (unsigned int i = 0; i < 16; i++) {
+			f();
+		}
+		iterations += 16;
+		elapsed = chrono::steady_clock::now() - start;
+	} while (elapsed.count() < 0.25);
+
+	return iterations / elapsed.count();
+}
+
+// Returns megabytes of output written per second
+static double time_it(function<void()> const& f, size_t bytes_per_call) {
+	return calls_per_second(f) * bytes_per_call / (1024.0 * 1024.0);
+}
+
+static void report(const char* name, double reference, double kernel, const char* unit = " MiB/s") {
+	cout << left << setw(32) << name << right << fixed << setprecision(0)
+		<< setw(10) << reference << unit << setw(10) << kernel << unit
+		<< setprecision(2) << setw(8) << kernel / reference << "x\n";
+}
+
+// Same size as AtlasGlyph
+struct LookupValue {
+	unsigned int x, y, layer, channel;
+	const void* glyph;
+};
+
+// Looks up every char code in text, as a layout loop would. Returns millions of lookups per second.
+template <typename F>
+static double lookup_rate(vector<CharCode> const& text, F find) {
+	volatile unsigned int sink = 0;
+	double calls = calls_per_second([&]() {
+		unsigned int sum = 0;
+		for (CharCode c : text) {
+			auto v = find(c);
+			sum += v ? v->x : 1;
+		}
+		sink = sink + sum;
+	});
+	return calls * text.size() / 1e6;
+}
+
+static void benchmark_lookups(const char* name, vector<CharCode> const& char_codes, vector<CharCode> const& text) {
+	map<CharCode, LookupValue> m;
+	CodepointTable<LookupValue> table;
+
+	for (CharCode c : char_codes) {
+		m.emplace(c, LookupValue{ c, c, 0, 0, nullptr });
+		table.emplace(c, LookupValue{ c, c, 0, 0, nullptr });
+	}
+
+	report(name,
+		lookup_rate(text, [&m](CharCode c) -> LookupValue const* {
+			auto i = m.find(c);
+			return i == m.end() ? nullptr : &(*i).second;
+		}),
+		lookup_rate(text, [&table](CharCode c) {
+			return table.find(c);
+		}), " M/s  ");
+}
+
+int main() {
+	cout << "Pixel kernels: " << get_pixel_kernels_name() << "\n\n";
+	cout << left << setw(32) << "" << right << setw(16) << "old loop" << setw(16) << "new" << "\n";
+
+	mt19937 rng(1234);
+
+	// Small glyph-sized bitmaps and one large image. Widths are not multiples of 16 so the tails are included.
+	struct Size { unsigned int width, height; const char* name; };
+	const Size sizes[] = { { 13, 17, "13x17" }, { 37, 41, "37x41" }, { 1021, 1024, "1021x1024" } };
+
+	bool all_correct = true;
+
+	for (auto const& size : sizes) {
+		int pitch = static_cast<int>((size.width * 3 + 3) & ~3u); // FreeType pads rows to 4 bytes
+		vector<unsigned char> src(pitch * size.height);
+		for (auto& b : src) {
+			b = static_cast<unsigned char>(rng());
+		}
+
+		vector<unsigned char> expected(size.width * size.height * 4);
+		vector<unsigned char> dst(size.width * size.height * 4);
+
+		auto new_rgb = [&]() {
+			unsigned char* d = dst.data();
+			const unsigned char* s = src.data();
+			for (unsigned int y = 0; y < size.height; y++) {
+				rgb_to_rgba(d, s, size.width);
+				d += size.width * 4;
+				s += pitch;
+			}
+		};
+		auto new_bgr = [&]() {
+			unsigned char* d = dst.data();
+			const unsigned char* s = src.data();
+			for (unsigned int y = 0; y < size.height; y++) {
+				bgr_to_rgba(d, s, size.width);
+				d += size.width * 4;
+				s += pitch;
+			}
+		};
+
+		reference_rgb_to_rgba(expected.data(), src.data(), size.width, size.height, pitch);
+		new_rgb();
+		all_correct = all_correct && expected == dst;
+
+		reference_bgr_to_rgba(expected.data(), src.data(), size.width, size.height, pitch);
+		new_bgr();
+		all_correct = all_correct && expected == dst;
+
+		vector<unsigned char> rgb_expected(size.width * size.height * 3);
+		vector<unsigned char> rgb(size.width * size.height * 3);
+
+		auto new_rgba_to_rgb = [&]() {
+			for (unsigned int y = 0; y < size.height; y++) {
+				rgba_to_rgb(&rgb[y * size.width * 3], &dst[y * size.width * 4], size.width);
+			}
+		};
+
+		reference_rgba_to_rgb(rgb_expected.data(), dst.data(), size.width, size.height);
+		new_rgba_to_rgb();
+		all_correct = all_correct && rgb_expected == rgb;
+
+		auto new_gray_to_rgba = [&]() {
+			for (unsigned int y = 0; y < size.height; y++) {
+				gray_to_rgba(&dst[y * size.width * 4], &src[y * size.width], size.width);
+			}
+		};
+
+		reference_gray_to_rgba(expected.data(), src.data(), size.width, size.height);
+		new_gray_to_rgba();
+		all_correct = all_correct && expected == dst;
+
+		report((string("rgb_to_rgba ") + size.name).c_str(),
+			time_it([&]() { reference_rgb_to_rgba(expected.data(), src.data(), size.width, size.height, pitch); }, dst.size()),
+			time_it(new_rgb, dst.size()));
+
+		report((string("bgr_to_rgba ") + size.name).c_str(),
+			time_it([&]() { reference_bgr_to_rgba(expected.data(), src.data(), size.width, size.height, pitch); }, dst.size()),
+			time_it(new_bgr, dst.size()));
+
+		report((string("rgba_to_rgb ") + size.name).c_str(),
+			time_it([&]() { reference_rgba_to_rgb(rgb_expected.data(), dst.data(), size.width, size.height); }, rgb.size()),
+			time_it(new_rgba_to_rgb, rgb.size()));
+
+		report((string("gray_to_rgba ") + size.name).c_str(),
+			time_it([&]() { reference_gray_to_rgba(expected.data(), src.data(), size.width, size.height); }, dst.size()),
+			time_it(new_gray_to_rgba, dst.size()));
+	}
+
+	for (auto const& size : sizes) {
+		if (size.width > 64) {
+			continue;
+		}
+
+		const unsigned int atlas_width = 1024;
+		vector<unsigned char> atlas(atlas_width * 64 * 4);
+		vector<unsigned char> glyph(size.width * size.height * 4, 7);
+
+		vector<unsigned char> expected(atlas);
+		reference_blit(expected.data(), glyph.data(), atlas_width, size.width, size.height);
+		blit_rows(atlas.data(), atlas_width * 4, glyph.data(), size.width * 4, size.width * 4, size.height);
+		all_correct = all_correct && expected == atlas;
+
+		report((string("blit ") + size.name + " into 1024 wide atlas").c_str(),
+			time_it([&]() { reference_blit(atlas.data(), glyph.data(), atlas_width, size.width, size.height); }, glyph.size()),
+			time_it([&]() { blit_rows(atlas.data(), atlas_width * 4, glyph.data(), size.width * 4, size.width * 4, size.height); }, glyph.size()));
+	}
+
+	{
+		// Coverage curve applied to LCD glyph bitmaps
+		vector<unsigned char> lut(256);
+		for (auto& v : lut) {
+			v = static_cast<unsigned char>(rng());
+		}
+
+		for (auto const& size : sizes) {
+			vector<unsigned char> data(size.width * size.height * 3);
+			for (auto& v : data) {
+				v = static_cast<unsigned char>(rng());
+			}
+
+			vector<unsigned char> expected(data);
+			for (auto& v : expected) {
+				v = lut[v];
+			}
+			vector<unsigned char> result(data);
+			apply_lut(result.data(), result.size(), lut.data());
+			all_correct = all_correct && expected == result;
+
+			report((string("apply_lut ") + size.name).c_str(),
+				time_it([&]() {
+					for (auto& v : result) {
+						v = lut[v];
+					}
+				}, result.size()),
+				time_it([&]() { apply_lut(result.data(), result.size(), lut.data()); }, result.size()));
+		}
+	}
+
+	cout << "\n" << left << setw(32) << "Glyph lookups" << right << setw(16) << "std::map" << setw(16) << "CodepointTable" << "\n";
+
+	{
+		// Latin-1 font, English text
+		vector<CharCode> latin1;
+		for (CharCode c = 32; c < 256; c++) {
+			if (c < 127 || c >= 160) {
+				latin1.push_back(c);
+			}
+		}
+
+		string lorem = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.";
+		vector<CharCode> text(lorem.begin(), lorem.end());
+
+		benchmark_lookups("latin-1, 191 glyphs", latin1, text);
+
+		// CJK font with 20000 glyphs, random text
+		vector<CharCode> cjk;
+		for (CharCode c = 0x4E00; c < 0x4E00 + 20000; c++) {
+			cjk.push_back(c);
+		}
+
+		vector<CharCode> cjk_text(4096);
+		for (auto& c : cjk_text) {
+			c = cjk[rng() % cjk.size()];
+		}
+
+		benchmark_lookups("cjk, 20000 glyphs", cjk, cjk_text);
+
+		// Correctness
+		CodepointTable<LookupValue> table;
+		for (CharCode c : cjk) {
+			table.emplace(c, LookupValue{ c, c, 0, 0, nullptr });
+		}
+		size_t n = 0;
+		for (auto [c, v] : table) {
+			all_correct = all_correct && v.x == c && c == cjk[n++];
+		}
+		all_correct = all_correct && n == cjk.size() && table.size() == cjk.size() && !table.find(0x4E00 - 1) && !table.find(0x10FFFF);
+	}
+
+	if (!all_correct) {
+		cerr << "Output does not match the old code\n";
+		return 1;
+	}
+
+	return 0;
+}
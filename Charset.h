@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+#include <tuple>
+
+namespace SubPixelFonts {
+
+	using CharCode = uint32_t;
+
+	// Set of char codes to load from a font
+	// Stored as sorted, non-overlapping ranges so that large sets (CJK etc.) stay small and fast to search.
+	// Only char codes that the font actually has are loaded, the font's character map is used to skip
+	// over the rest so listing large ranges is cheap.
+	// Char code 0 is never loaded as it is used by the texture atlas cache files for the white pixel.
+
+	class Charset {
+	public:
+		Charset() {} // Empty
+
+		// Printable ASCII and Latin-1 (32-126, 160-255)
+		static Charset latin1() {
+			return Charset().add_range(32, 126).add_range(160, 255);
+		}
+
+		// Every char code the font has
+		static Charset all() {
+			Charset c;
+			c.everything = true;
+			return c;
+		}
+
+		// Inclusive
+		Charset& add_range(CharCode first, CharCode last) {
+			if (first > last) {
+				std::swap(first, last);
+			}
+
+			// In 64 bits so that a range ending at the largest char code does not wrap around
+			if (ranges.empty() || first > static_cast<uint64_t>(ranges.back().second) + 1) {
+				// Common case, added in ascending order
+				ranges.emplace_back(first, last);
+			}
+			else if (first >= ranges.back().first) {
+				ranges.back().second = std::max(ranges.back().second, last);
+			}
+			else {
+				ranges.emplace_back(first, last);
+				normalise();
+			}
+			return *this;
+		}
+
+		Charset& add(CharCode c) {
+			return add_range(c, c);
+		}
+
+		Charset& add(std::vector<CharCode> const& char_codes) {
+			for (auto c : char_codes) {
+				ranges.emplace_back(c, c);
+			}
+			normalise();
+			return *this;
+		}
+
+		Charset& add(std::initializer_list<CharCode> char_codes) {
+			return add(std::vector<CharCode>(char_codes));
+		}
+
+		bool contains(CharCode c) const {
+			if (everything) {
+				return true;
+			}
+
+			// First range that starts after c
+			auto r = std::upper_bound(ranges.begin(), ranges.end(), c, [](CharCode c, std::pair<CharCode, CharCode> const& range) {
+				return c < range.first;
+			});
+
+			return r != ranges.begin() && c <= (r - 1)->second;
+		}
+
+		bool contains_everything() const {
+			return everything;
+		}
+
+		// Sorted, non-overlapping and non-adjacent inclusive ranges
+		std::vector<std::pair<CharCode, CharCode>> const& get_ranges() const {
+			return ranges;
+		}
+
+		bool operator<(Charset const& other) const {
+			return std::tie(everything, ranges) < std::tie(other.everything, other.ranges);
+		}
+
+	private:
+		bool everything = false;
+		std::vector<std::pair<CharCode, CharCode>> ranges;
+
+		void normalise() {
+			std::sort(ranges.begin(), ranges.end());
+
+			std::vector<std::pair<CharCode, CharCode>> merged;
+			merged.reserve(ranges.size());
+
+			for (auto const& r : ranges) {
+				if (!merged.empty() && r.first <= static_cast<uint64_t>(merged.back().second) + 1) {
+					merged.back().second = std::max(merged.back().second, r.second);
+				}
+				else {
+					merged.push_back(r);
+				}
+			}
+
+			ranges = std::move(merged);
+		}
+	};
+
+}
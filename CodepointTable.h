@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+#include "Charset.h"
+#include "Assert.h"
+
+namespace SubPixelFonts {
+
+	// Maps char codes to values with a two level table: the char code's high bits pick a page of 256 entries
+	// and the low 8 bits pick the entry. Looking up a char code is two array accesses instead of a tree walk.
+	// The page for ASCII/Latin-1 is always allocated, other pages are allocated when something is stored in them.
+	// Values never move once inserted so pointers to them stay valid until the table is destroyed.
+	// Iterates in char code order like std::map. Char codes above MAX_CHAR_CODE cannot be stored.
+
+	template <typename T>
+	class CodepointTable {
+		static constexpr unsigned int PAGE_BITS = 8;
+		static constexpr CharCode PAGE_SIZE = 1 << PAGE_BITS;
+
+		struct Page {
+			std::optional<T> entries[PAGE_SIZE];
+		};
+
+		template <bool Const>
+		class Iterator {
+			using Table = std::conditional_t<Const, const CodepointTable, CodepointTable>;
+			using Value = std::conditional_t<Const, const T, T>;
+		public:
+			Iterator(Table* table_, CharCode c) : table(table_), char_code(c) {
+				skip_empty();
+			}
+
+			std::pair<CharCode, Value&> operator*() const {
+				return { char_code, *table->pages[char_code >> PAGE_BITS]->entries[char_code & (PAGE_SIZE - 1)] };
+			}
+
+			Iterator& operator++() {
+				char_code++;
+				skip_empty();
+				return *this;
+			}
+
+			bool operator==(Iterator const& other) const { return char_code == other.char_code; }
+			bool operator!=(Iterator const& other) const { return char_code != other.char_code; }
+		private:
+			Table* table;
+			CharCode char_code; // table->end_code() at the end
+
+			void skip_empty() {
+				while (char_code < table->end_code()) {
+					auto const& page = table->pages[char_code >> PAGE_BITS];
+					if (!page) {
+						char_code = (char_code | (PAGE_SIZE - 1)) + 1;
+					}
+					else if (page->entries[char_code & (PAGE_SIZE - 1)].has_value()) {
+						return;
+					}
+					else {
+						char_code++;
+					}
+				}
+			}
+		};
+
+	public:
+		// Highest Unicode code point. Larger char codes cannot be stored.
+		static constexpr CharCode MAX_CHAR_CODE = 0x10FFFF;
+
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		CodepointTable() {
+			pages.push_back(std::make_unique<Page>());
+		}
+
+		// Returns nullptr if there is no value for the char code
+		T* find(CharCode char_code) {
+			auto page = char_code >> PAGE_BITS;
+			if (page >= pages.size() || !pages[page]) {
+				return nullptr;
+			}
+
+			auto& entry = pages[page]->entries[char_code & (PAGE_SIZE - 1)];
+			return entry.has_value() ? &entry.value() : nullptr;
+		}
+
+		T const* find(CharCode char_code) const {
+			return const_cast<CodepointTable*>(this)->find(char_code);
+		}
+
+		bool contains(CharCode char_code) const {
+			return find(char_code) != nullptr;
+		}
+
+		// Constructs the value if the char code is not in the table yet, otherwise returns the existing value
+		template <typename... Args>
+		T& emplace(CharCode char_code, Args&&... args) {
+			assert__(char_code <= MAX_CHAR_CODE, "Char code is outside of Unicode");
+
+			auto page = char_code >> PAGE_BITS;
+			if (page >= pages.size()) {
+				pages.resize(page + 1);
+			}
+			if (!pages[page]) {
+				pages[page] = std::make_unique<Page>();
+			}
+
+			auto& entry = pages[page]->entries[char_code & (PAGE_SIZE - 1)];
+			if (!entry.has_value()) {
+				entry.emplace(std::forward<Args>(args)...);
+				count++;
+			}
+			return entry.value();
+		}
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, end_code()); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, end_code()); }
+
+		CodepointTable(const CodepointTable&) = delete;
+		CodepointTable& operator=(const CodepointTable&) = delete;
+
+		CodepointTable(CodepointTable&&) = default;
+		CodepointTable& operator=(CodepointTable&&) = default;
+	private:
+		std::vector<std::unique_ptr<Page>> pages;
+		size_t count = 0;
+
+		CharCode end_code() const {
+			return static_cast<CharCode>(pages.size()) << PAGE_BITS;
+		}
+	};
+}
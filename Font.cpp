@@ -1,9 +1,29 @@
 #include "Font.h"
 #include "Assert.h"
+#include "PixelKernels.h"
+#include "KeepAliveCache.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_LCD_FILTER_H
+#include FT_OUTLINE_H
+#include FT_TRUETYPE_TAGS_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_SIZES_H
+#include FT_CACHE_H
+#include FT_GLYPH_H
+#include FT_ADVANCES_H
+#include FT_MULTIPLE_MASTERS_H
+#include FT_MODULE_H
+
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
 
 using namespace std;
 
@@ -12,163 +32,1111 @@ namespace SubPixelFonts {
 
 	static FT_Library library;
 
-	void Font::init() {
+	// FreeType requires FT_New_Face and FT_Done_Face calls that use the same library to be serialised
+	static mutex library_mutex;
+
+	// Glyph cache. Not thread-safe, and it opens and closes faces on the shared library, so it is only used with library_mutex locked.
+	static FTC_Manager cache_manager = nullptr;
+	static FTC_ImageCache image_cache;
+	static FTC_CMapCache cmap_cache;
+
+	// What the cache's face requester opens. One per file path and variation, used as the FTC_FaceID.
+	struct CacheFaceSource {
+		string file_path;
+		shared_ptr<MappedFile> mapped_file;
+		vector<FT_Fixed> variation_coords;
+	};
+	static map<pair<string, vector<FT_Fixed>>, unique_ptr<CacheFaceSource>> cache_face_sources;
+
+	static FT_Error open_face(FT_Library library, string const& file_path, MappedFile const* mapped_file, FT_Face* face);
+
+	// Called by the cache with library_mutex locked
+	static FT_Error request_cache_face(FTC_FaceID face_id, FT_Library library, FT_Pointer, FT_Face* face) {
+		auto source = static_cast<CacheFaceSource*>(face_id);
+
+		FT_Error error = open_face(library, source->file_path, source->mapped_file.get(), face);
+		if (!error && !source->variation_coords.empty()) {
+			error = FT_Set_Var_Design_Coordinates(*face, static_cast<FT_UInt>(source->variation_coords.size()), source->variation_coords.data());
+			if (error) {
+				FT_Done_Face(*face);
+			}
+		}
+		return error;
+	}
+
+	// library_mutex must be locked
+	static FTC_FaceID get_cache_face_id(string const& file_path, shared_ptr<MappedFile> const& mapped_file, vector<FT_Fixed> const& variation_coords) {
+		auto& source = cache_face_sources[make_pair(file_path, variation_coords)];
+		if (!source) {
+			source = make_unique<CacheFaceSource>(CacheFaceSource{ file_path, mapped_file, variation_coords });
+		}
+		return source.get();
+	}
+
+	void Font::init(size_t glyph_cache_bytes) {
 		assert__(!FT_Init_FreeType(&library), "Error initialising FreeType");
 		FT_Library_SetLcdFilter(library, FT_LCD_FILTER_DEFAULT);
+
+		if (glyph_cache_bytes) {
+			assert__(!FTC_Manager_New(library, 8, 32, glyph_cache_bytes, request_cache_face, nullptr, &cache_manager),
+				"Error creating glyph cache");
+			assert__(!FTC_ImageCache_New(cache_manager, &image_cache), "Error creating glyph cache");
+			assert__(!FTC_CMapCache_New(cache_manager, &cmap_cache), "Error creating glyph cache");
+		}
 	}
 
+	// Recently loaded fonts and font instances, see Font::set_keep_alive(..)
+	static KeepAliveCache keep_alive;
+
+	static atomic<uint64_t> font_hits, font_misses, instance_hits, instance_misses;
+
 	void Font::deinit() {
+		// Kept alive fonts and font instances use the library
+		keep_alive.clear();
+
+		if (cache_manager) {
+			FTC_Manager_Done(cache_manager);
+			cache_manager = nullptr;
+			cache_face_sources.clear();
+		}
+
 		FT_Done_FreeType(library);
 	}
 
-	static map<string, weak_ptr<Font>> fonts;
+	// Split by file path hash so that loading one font does not stop other fonts being loaded
+	static WeakRegistry<string, Font> fonts[16];
 
-	shared_ptr<Font> Font::load(string const& file_path, bool load) {
-		shared_ptr<Font> font_pointer = nullptr;
+	shared_ptr<Font> Font::load(string const& file_path, bool load, bool memory_map) {
+		auto& registry = fonts[hash<string>()(file_path) % size(fonts)];
 
-		auto font = fonts.find(file_path);
+		bool created = false;
+		auto font = registry.get_or_create(file_path,
+			[&]() {
+				created = true;
+				return make_shared<Font>(file_path, load, memory_map);
+			},
+			[load](shared_ptr<Font> const& font) {
+				// A font created for a cached texture atlas has no face so it is replaced if the file needs to be loaded
+				return !load || font->face.has_value();
+			});
 
-		if (font != fonts.end()) {
-			font_pointer = (*font).second.lock();
-		}
+		(created ? font_misses : font_hits)++;
+		keep_alive.touch(font, font->get_memory_usage());
 
-		if (font_pointer == nullptr) {
-			// Create font
-			font_pointer = make_shared<Font>(file_path);
-			fonts.insert({ file_path, font_pointer });
-		}
+		return font;
+	}
 
-		return font_pointer;
+	void Font::set_keep_alive(size_t max_bytes, chrono::steady_clock::duration max_age) {
+		keep_alive.configure(max_bytes, max_age);
 	}
 
-	Font::Font(string const& file_path, bool load) {
+	void Font::prune_keep_alive() {
+		keep_alive.prune();
+	}
+
+	FontCacheStats Font::get_cache_stats() {
+		FontCacheStats stats;
+		stats.font_hits = font_hits;
+		stats.font_misses = font_misses;
+		stats.instance_hits = instance_hits;
+		stats.instance_misses = instance_misses;
+		stats.kept_alive = keep_alive.get_count();
+		stats.kept_alive_bytes = keep_alive.get_bytes();
+		return stats;
+	}
+
+	// Opens the font from the mapping if there is one, otherwise from the file
+	static FT_Error open_face(FT_Library library, string const& file_path, MappedFile const* mapped_file, FT_Face* face) {
+		if (mapped_file) {
+			return FT_New_Memory_Face(library, mapped_file->data(), static_cast<FT_Long>(mapped_file->size()), 0, face);
+		}
+		return FT_New_Face(library, file_path.c_str(), 0, face);
+	}
+
+	Font::Font(string const& file_path_, bool load, bool memory_map) : file_path(file_path_) {
 		if (load) {
+			if (memory_map) {
+				mapped_file = MappedFile::open(file_path);
+			}
+
+			lock_guard<mutex> lock(library_mutex);
+
 			face = nullptr;
-			assert__(!FT_New_Face(library,
-				file_path.c_str(),
-				0,
-				(FT_Face*)&face.value()), "Error loading font");
+			assert__(!open_face(library, file_path, mapped_file.get(), (FT_Face*)&face.value()), "Error loading font");
 		}
 	}
 
 	Font::~Font() {
 		if (face.has_value()) {
+			lock_guard<mutex> lock(library_mutex);
 			FT_Done_Face(reinterpret_cast<FT_Face>(face.value()));
 		}
 	}
 
-	shared_ptr<FontInstance> Font::load_font_instance(FontHeight height_in_pixels, bool load) {
-		shared_ptr<FontInstance> font_instance_pointer = nullptr;
+	size_t Font::get_memory_usage() const {
+		return face.has_value() ? static_cast<size_t>(reinterpret_cast<FT_Face>(face.value())->stream->size) : 0;
+	}
+
+	// Points to the font instance and also owns its font
+	static shared_ptr<FontInstance> hold_font(shared_ptr<Font> const& font, shared_ptr<FontInstance> const& font_instance) {
+		auto owners = make_shared<pair<shared_ptr<Font>, shared_ptr<FontInstance>>>(font, font_instance);
+		return shared_ptr<FontInstance>(owners, font_instance.get());
+	}
 
-		auto font_instance = instances.find(height_in_pixels);
+	shared_ptr<FontInstance> Font::load_font_instance(FontSize font_size, bool load, FontInstanceOptions const& options) {
+		bool created = false;
+		auto font_instance = instances.get_or_create(make_pair(font_size, options), [&]() {
+			created = true;
+			return make_shared<FontInstance>(*this, font_size, options, load);
+		});
 
-		if (font_instance != instances.end()) {
-			font_instance_pointer = (*font_instance).second.lock();
-		}
+		(created ? instance_misses : instance_hits)++;
 
-		if (font_instance_pointer == nullptr) {
-			// Create font instance
-			font_instance_pointer = make_shared<FontInstance>(load ? face.value() : nullptr, height_in_pixels, load);
-			instances.insert({ height_in_pixels, font_instance_pointer });
-		}
+		// A kept alive font instance keeps its font, which has the registry it is found in. The font is touched afterwards
+		// so that it is not released before the font instance and its size is counted while it is kept.
+		auto font = shared_from_this();
+		keep_alive.touch(hold_font(font, font_instance), font_instance->get_memory_usage());
+		keep_alive.touch(font, get_memory_usage());
 
-		return font_instance_pointer;
+		return font_instance;
 	}
 
-	FontInstance::FontInstance(FontFace face_, FontHeight height_in_pixels, bool load) {
-		if (!load) {
-			data_freed = true;
-			return;
-		}
+	future<vector<shared_ptr<FontInstance>>> Font::prefetch(vector<pair<string, FontSize>> const& fonts_to_load,
+		FontInstanceOptions const& options, function<void(vector<shared_ptr<FontInstance>> const&)> on_loaded)
+	{
+		return async(launch::async, [fonts_to_load, options, on_loaded]() {
+			vector<shared_ptr<FontInstance>> font_instances(fonts_to_load.size());
 
-		auto face = reinterpret_cast<FT_Face>(face_);
+			// Indexes into fonts_to_load by file. The face is locked while a font instance is created, so the sizes of a
+			// font are loaded one after the other and different fonts in parallel.
+			map<string, vector<size_t>> by_file;
+			for (size_t i = 0; i < fonts_to_load.size(); i++) {
+				by_file[fonts_to_load[i].first].push_back(i);
+			}
 
-		auto size_in_inches = height_in_pixels / 96.0;
-		auto size_in_points = size_in_inches * 72.0;
+			vector<future<void>> loading;
+			for (auto const& [file_path, indexes] : by_file) {
+				loading.push_back(async(launch::async, [&, file_path = file_path, indexes = indexes]() {
+					// The font instances keep their font, and so the registry that load_font_instance(..) finds them in
+					auto font = Font::load(file_path);
+					for (size_t i : indexes) {
+						font_instances[i] = hold_font(font, font->load_font_instance(fonts_to_load[i].second, true, options));
+					}
+				}));
+			}
+
+			// Every thread has to finish before font_instances goes out of scope, so errors are rethrown afterwards
+			exception_ptr error;
+			for (auto& f : loading) {
+				try {
+					f.get();
+				}
+				catch (...) {
+					if (!error) {
+						error = current_exception();
+					}
+				}
+			}
+			if (error) {
+				rethrow_exception(error);
+			}
 
+			if (on_loaded) {
+				on_loaded(font_instances);
+			}
+			return font_instances;
+		});
+	}
+
+	static void set_char_size(FT_Face face, FontSize font_size) {
+		// Set from the pixel size (1 point = 1 pixel at 72 dpi) so that sizes that share a font instance are identical
 		assert_(!FT_Set_Char_Size(
 			face,
 			0,       /* char_width in 1/64th of points (=char_height)  */
-			static_cast<long>(size_in_points * 64),   /* char_height in 1/64th of points */
-			96,     /* ppi */
+			font_size.get_pixels_64(),   /* char_height in 1/64th of points */
+			72,     /* ppi */
 			0
 		));
+	}
 
+	// Full hinting moves stems to whole pixels, which would undo the subpixel offset
+	static FT_Int32 get_load_flags(FontInstanceOptions const& options, GlyphQuality quality = GlyphQuality::Final) {
+		// Hinting fits outlines to the pixel grid of one size, which distance fields are not drawn at.
+		// Draft glyphs skip it because it is a large part of the time taken to load a glyph.
+		if (options.render_mode == RenderMode::SDF || quality == GlyphQuality::Draft) {
+			return FT_LOAD_NO_HINTING;
+		}
+		return options.subpixel_phases > 1 ? FT_LOAD_TARGET_LIGHT : FT_LOAD_DEFAULT;
+	}
 
+	// The spread of FreeType's SDF renderers is a library property, not a render argument. Renders that use the shared
+	// library set it and render with this locked as other font instances can be rendering with a different spread.
+	static mutex sdf_mutex;
+
+	// Draft LCD glyphs are rendered in grayscale, which is quicker, and stored in the LCD pixel format
+	static RenderMode get_render_mode(FontInstanceOptions const& options, GlyphQuality quality) {
+		return options.render_mode == RenderMode::LCD && quality == GlyphQuality::Draft ? RenderMode::Grayscale : options.render_mode;
+	}
+
+	// Calls render(FT_Render_Mode) for a glyph that belongs to glyph_library
+	template <typename Render>
+	static FT_Error render_glyph(FT_Library glyph_library, RenderMode render_mode, unsigned int sdf_spread, Render render) {
+		switch (render_mode) {
+		case RenderMode::LCD:
+			return render(FT_RENDER_MODE_LCD);
+		case RenderMode::Grayscale:
+			return render(FT_RENDER_MODE_NORMAL);
+		default:
+			break;
+		}
+
+		// Worker threads have their own library
+		unique_lock<mutex> lock(sdf_mutex, defer_lock);
+		if (glyph_library == library) {
+			lock.lock();
+		}
+
+		// "sdf" renders outlines, "bsdf" renders bitmap glyphs
+		FT_Int spread = static_cast<FT_Int>(sdf_spread);
+		FT_Property_Set(glyph_library, "sdf", "spread", &spread);
+		FT_Property_Set(glyph_library, "bsdf", "spread", &spread);
+
+		return render(FT_RENDER_MODE_SDF);
+	}
+
+	// Synthetic bold strength in 1/64ths of a pixel, the same as FT_GlyphSlot_Embolden
+	static FT_Pos get_bold_strength(FT_Size size) {
+		return FT_MulFix(size->face->units_per_EM, size->metrics.y_scale) / 24;
+	}
 
-		auto f = [face, this](CharCode start, CharCode end) {
-			for (CharCode char_code = start; char_code <= end; char_code++) {
-				auto glyph_index = FT_Get_Char_Index(face, char_code);
-				if (glyph_index <= 0) {
+	// Synthetic bold and oblique, the same as FT_GlyphSlot_Embolden and FT_GlyphSlot_Oblique.
+	// Returns how much wider the glyph became in 1/64ths of a pixel, which is added to its advance.
+	static FT_Pos apply_synthetic_style(FT_Outline* outline, FT_Pos bold_strength, FontInstanceOptions const& options) {
+		FT_Pos extra_advance = 0;
+
+		if (options.synthetic_bold) {
+			FT_Outline_EmboldenXY(outline, bold_strength, bold_strength);
+			extra_advance = bold_strength;
+		}
+
+		if (options.synthetic_oblique) {
+			// x += 0.2126 * y
+			FT_Matrix shear = { 0x10000, 0x0366A, 0, 0x10000 };
+			FT_Outline_Transform(outline, &shear);
+		}
+
+		return extra_advance;
+	}
+
+	// Copies a rendered bitmap into the glyph, converting it to the glyph's pixel format
+	static void copy_bitmap(Glyph& glyph, FT_Bitmap const* bitmap, RenderMode render_mode, GlyphArena& arena, const unsigned char* coverage_lut) {
+		bool lcd = render_mode == RenderMode::LCD;
+
+		// FT_PIXEL_MODE_GRAY for 8-bit grey fonts and distance fields
+		// FT_PIXEL_MODE_LCD for RGB fonts for horizontal displays
+		assert_(bitmap->pixel_mode == (lcd ? FT_PIXEL_MODE_LCD : FT_PIXEL_MODE_GRAY));
+
+		int pitch = bitmap->pitch; // width in bytes
+
+		unsigned int src_bytes_per_pixel = lcd ? 3 : 1;
+		assert_(static_cast<unsigned>(pitch) >= bitmap->width);
+
+		// The LCD filter widens the bitmap by a pixel or more on each side and those columns are often empty.
+		// Only the inked bounds are kept so the atlas doesn't store, and the renderer doesn't draw, empty pixels.
+		// Distance fields are kept whole as their zero border stops linear filtering picking up neighbouring glyphs.
+		unsigned int x0 = 0, x1 = bitmap->width, y0 = 0, y1 = bitmap->rows; // Inked bytes are in [x0, x1) and [y0, y1)
+		if (render_mode != RenderMode::SDF) {
+			x0 = bitmap->width;
+			x1 = 0;
+			y0 = bitmap->rows;
+			y1 = 0;
+
+			for (unsigned int y = 0; y < bitmap->rows; y++) {
+				const unsigned char* row = bitmap->buffer + static_cast<size_t>(y) * pitch;
+
+				unsigned int first = 0, last = bitmap->width;
+				while (first < last && !row[first]) {
+					first++;
+				}
+				if (first == last) {
 					continue;
 				}
-				glyphs.emplace(make_pair(char_code, Glyph(face, char_code, glyph_index)));
+				while (!row[last - 1]) {
+					last--;
+				}
+
+				x0 = min(x0, first);
+				x1 = max(x1, last);
+				y0 = min(y0, y);
+				y1 = y + 1;
+			}
+		}
+
+		if (x0 >= x1 || y0 >= y1) {
+			glyph.bitmap_width = glyph.bitmap_height = 0;
+			return;
+		}
+
+		x0 /= src_bytes_per_pixel;
+		x1 = (x1 + src_bytes_per_pixel - 1) / src_bytes_per_pixel;
+
+		glyph.left += static_cast<int>(x0);
+		glyph.top -= static_cast<int>(y0);
+		glyph.bitmap_width = x1 - x0;
+		glyph.bitmap_height = y1 - y0;
+
+		if (glyph.get_bitmap_size_bytes() > 0) {
+			glyph.bitmap_data = arena.allocate(glyph.get_bitmap_size_bytes());
+
+			unsigned char* dst = glyph.bitmap_data;
+			const unsigned char* src = bitmap->buffer + static_cast<size_t>(y0) * pitch + x0 * src_bytes_per_pixel;
+
+			// Grayscale bitmaps for draft LCD glyphs have the coverage copied to every colour channel
+			using Convert = void (*)(unsigned char*, const unsigned char*, size_t);
+			Convert convert = nullptr;
+
+			if (glyph.format == PixelFormat::RGBA8) {
+				convert = lcd ? rgb_to_rgba : gray_to_rgba;
+			}
+			else if (glyph.format == PixelFormat::RGB8 && !lcd) {
+				convert = gray_to_rgb;
+			}
+
+			if (convert) {
+				for (unsigned int y = 0; y < glyph.bitmap_height; y++) {
+					convert(dst, src, glyph.bitmap_width);
+					dst += glyph.bitmap_width * get_bytes_per_pixel(glyph.format);
+					src += pitch;
+				}
+			}
+			else {
+				// Already in the right format
+				blit_rows(dst, glyph.bitmap_width * src_bytes_per_pixel, src, pitch, glyph.bitmap_width * src_bytes_per_pixel, glyph.bitmap_height);
+			}
+
+			// Maps 255 to 255 so RGBA alpha is unchanged
+			if (coverage_lut) {
+				apply_lut(glyph.bitmap_data, glyph.get_bitmap_size_bytes(), coverage_lut);
+			}
+
+		}
+	}
+
+	// Same as the Glyph constructor but the outline comes from the glyph cache.
+	// Only the cache lookup holds library_mutex so several threads can render cached glyphs at once.
+	static Glyph render_cached_glyph(FTC_FaceID face_id, FontSize font_size, uint32_t glyph_index, FontInstanceOptions const& options,
+		GlyphArena& arena, unsigned int phase, const unsigned char* coverage_lut, GlyphQuality quality = GlyphQuality::Final)
+	{
+		auto load_flags = get_load_flags(options, quality);
+		auto render_mode = get_render_mode(options, quality);
+
+		// Same character size as set_char_size(..)
+		FTC_ScalerRec scaler = { face_id, font_size.get_pixels_64(), font_size.get_pixels_64(), 0, 72, 72 };
+
+		FT_Glyph outline;
+		FT_Fixed linear_advance;
+		FT_Pos bold_strength;
+		{
+			lock_guard<mutex> lock(library_mutex);
+
+			FT_Glyph cached;
+			assert_(!FTC_ImageCache_LookupScaler(image_cache, &scaler, load_flags, glyph_index, &cached, nullptr));
+
+			// The cached glyph can be flushed by the next lookup
+			assert_(!FT_Glyph_Copy(cached, &outline));
+
+			// FT_Glyph only has the hinted advance. For TrueType fonts this reads the same value as linearHoriAdvance.
+			FT_Size size;
+			assert_(!FTC_Manager_LookupSize(cache_manager, &scaler, &size));
+			assert_(!FT_Get_Advance(size->face, glyph_index, load_flags | FT_LOAD_NO_HINTING, &linear_advance));
+
+			// FTC can close the face once the mutex is unlocked
+			bold_strength = get_bold_strength(size);
+		}
+
+		unique_ptr<FT_GlyphRec_, void(*)(FT_Glyph)> owner(outline, FT_Done_Glyph);
+
+		FT_Pos extra_advance = 0;
+		if (outline->format == FT_GLYPH_FORMAT_OUTLINE) {
+			auto& ft_outline = reinterpret_cast<FT_OutlineGlyph>(outline)->outline;
+
+			extra_advance = apply_synthetic_style(&ft_outline, bold_strength, options);
+
+			if (phase) {
+				FT_Outline_Translate(&ft_outline, static_cast<FT_Pos>(phase * 64 / options.subpixel_phases), 0);
+			}
+		}
+
+		Glyph glyph;
+		glyph.format = options.get_glyph_pixel_format();
+		glyph.quality = quality;
+		glyph.advance = static_cast<unsigned>(((outline->advance.x >> 10) + extra_advance) / 64); // 16.16 -> 26.6 -> pixels
+		glyph.advance_64 = static_cast<unsigned>(((linear_advance + 512) >> 10) + extra_advance);
+
+		// FreeType's SDF renderer fails on empty outlines in an FT_Glyph. Other render modes are rendered so that left and
+		// top are the same as the uncached path's, e.g. -1 for a space with the LCD filter.
+		if (render_mode == RenderMode::SDF && outline->format == FT_GLYPH_FORMAT_OUTLINE
+			&& !reinterpret_cast<FT_OutlineGlyph>(outline)->outline.n_points) {
+			return glyph;
+		}
+
+		FT_Glyph bitmap_glyph = owner.release();
+		FT_Error error = render_glyph(bitmap_glyph->library, render_mode, options.sdf_spread, [&](FT_Render_Mode ft_render_mode) {
+			return FT_Glyph_To_Bitmap(&bitmap_glyph, ft_render_mode, nullptr, 1);
+		});
+		owner.reset(bitmap_glyph);
+		assert_(!error);
+
+		auto bitmap = reinterpret_cast<FT_BitmapGlyph>(bitmap_glyph);
+		glyph.left = bitmap->left;
+		glyph.top = bitmap->top;
+
+		copy_bitmap(glyph, &bitmap->bitmap, render_mode, arena, coverage_lut);
+
+		return glyph;
+	}
+
+	// FreeType library and face owned by a single rasterisation thread
+
+	class WorkerFace {
+	public:
+		// mapped_file can be nullptr
+		WorkerFace(string const& file_path, MappedFile const* mapped_file, FontSize font_size, vector<FT_Fixed> variation_coords) {
+			assert__(!FT_Init_FreeType(&library), "Error initialising FreeType");
+			FT_Library_SetLcdFilter(library, FT_LCD_FILTER_DEFAULT);
+
+			if (open_face(library, file_path, mapped_file, &face)) {
+				FT_Done_FreeType(library);
+				throw runtime_error("Error loading font");
+			}
+
+			if (!variation_coords.empty()) {
+				FT_Set_Var_Design_Coordinates(face, static_cast<FT_UInt>(variation_coords.size()), variation_coords.data());
+			}
+
+			set_char_size(face, font_size);
+		}
+
+		~WorkerFace() {
+			FT_Done_Face(face);
+			FT_Done_FreeType(library);
+		}
+
+		FT_Face get() const { return face; }
+
+		WorkerFace(const WorkerFace&) = delete;
+		WorkerFace& operator=(const WorkerFace&) = delete;
+	private:
+		FT_Library library;
+		FT_Face face;
+	};
+
+	using GlyphList = vector<pair<CharCode, FT_UInt>>; // char code, glyph index
+
+	// See FontInstanceOptions::gamma and contrast
+	static vector<unsigned char> make_coverage_lut(double gamma, double contrast) {
+		vector<unsigned char> lut(256);
+		for (unsigned int i = 0; i < 256; i++) {
+			double c = pow(i / 255.0, 1.0 / gamma);
+			c += contrast * (c * c * (3 - 2 * c) - c);
+			lut[i] = static_cast<unsigned char>(clamp(c * 255.0 + 0.5, 0.0, 255.0));
+		}
+		return lut;
+	}
+
+	// Design coordinates for every axis of a variable font, with the values in variation replacing the defaults.
+	// Empty if the font is not a variable font.
+	static vector<FT_Fixed> get_variation_coords(FT_Face face, map<string, double> const& variation) {
+		vector<FT_Fixed> coords;
+
+		if (!FT_HAS_MULTIPLE_MASTERS(face)) {
+			if (!variation.empty()) {
+				throw runtime_error("Font is not a variable font");
+			}
+			return coords;
+		}
+
+		FT_MM_Var* axes;
+		assert__(!FT_Get_MM_Var(face, &axes), "Error reading font variation axes");
+		unique_ptr<FT_MM_Var, void(*)(FT_MM_Var*)> axes_owner(axes, [](FT_MM_Var* a) { FT_Done_MM_Var(library, a); });
+
+		for (FT_UInt i = 0; i < axes->num_axis; i++) {
+			coords.push_back(axes->axis[i].def);
+		}
+
+		for (auto const& [tag, value] : variation) {
+			if (tag.size() != 4) {
+				throw runtime_error("Invalid variation axis tag: " + tag);
+			}
+
+			auto ft_tag = FT_MAKE_TAG(tag[0], tag[1], tag[2], tag[3]);
+
+			FT_UInt i = 0;
+			while (i < axes->num_axis && axes->axis[i].tag != ft_tag) {
+				i++;
+			}
+			if (i == axes->num_axis) {
+				throw runtime_error("Font does not have variation axis " + tag);
+			}
+
+			auto const& axis = axes->axis[i];
+			coords[i] = clamp(static_cast<FT_Fixed>(value * 65536.0), axis.minimum, axis.maximum);
+		}
+
+		return coords;
+	}
+
+	// Returns true if the face's variation was changed
+	static bool set_variation(FT_Face face, vector<FT_Fixed>& face_variation, vector<FT_Fixed> const& coords) {
+		if (coords.empty() || coords == face_variation) {
+			return false;
+		}
+
+		assert__(!FT_Set_Var_Design_Coordinates(face, static_cast<FT_UInt>(coords.size()), const_cast<FT_Fixed*>(coords.data())),
+			"Error setting font variation");
+		face_variation = coords;
+		return true;
+	}
+
+	// Finds every char code in the charset that the font has.
+	// Walks the font's character map rather than looking up every char code in the charset, so large
+	// sparse ranges only cost as much as the number of characters in the font that fall within them.
+	static GlyphList list_glyphs(FT_Face face, Charset const& charset) {
+		GlyphList glyphs;
+
+		FT_UInt glyph_index;
+		auto add_from = [face, &glyphs, &glyph_index](FT_ULong char_code, CharCode last) {
+			while (glyph_index != 0 && char_code <= last) {
+				if (char_code != 0) {
+					glyphs.emplace_back(static_cast<CharCode>(char_code), glyph_index);
+				}
+				char_code = FT_Get_Next_Char(face, char_code, &glyph_index);
 			}
 		};
 
-		f(32, 126);
-		f(160, 255);
+		if (charset.contains_everything()) {
+			auto char_code = FT_Get_First_Char(face, &glyph_index);
+			add_from(char_code, CodepointTable<Glyph>::MAX_CHAR_CODE);
+			return glyphs;
+		}
+
+		for (auto [first, last] : charset.get_ranges()) {
+			if (first > CodepointTable<Glyph>::MAX_CHAR_CODE) {
+				break;
+			}
+			last = min(last, CodepointTable<Glyph>::MAX_CHAR_CODE);
+
+			if (first == last) {
+				glyph_index = FT_Get_Char_Index(face, first);
+				add_from(first, last);
+			}
+			else if (first == 0) {
+				auto char_code = FT_Get_First_Char(face, &glyph_index);
+				add_from(char_code, last);
+			}
+			else {
+				auto char_code = FT_Get_Next_Char(face, first - 1, &glyph_index);
+				add_from(char_code, last);
+			}
+		}
+
+		return glyphs;
 	}
 
-	void FontInstance::free_data() {
-		data_freed = true;
-		for (auto& [_, glyph] : glyphs) {
-			glyph.free_data();
+	// Reads the format 0 subtables of the TrueType 'kern' table, which are what FT_Get_Kerning uses.
+	// Reading the pairs straight from the table is much faster than calling FT_Get_Kerning for every pair of glyphs.
+	// Values are the same as FT_KERNING_UNFITTED.
+	static KerningTable read_kerning(FT_Face face, GlyphList const& glyphs) {
+		KerningTable kerning;
+
+		FT_ULong length = 0;
+		if (!FT_IS_SFNT(face) || FT_Load_Sfnt_Table(face, TTAG_kern, 0, nullptr, &length) || length < 4) {
+			return kerning;
+		}
+
+		vector<FT_Byte> table(length);
+		if (FT_Load_Sfnt_Table(face, TTAG_kern, 0, table.data(), &length)) {
+			return kerning;
 		}
+
+		auto u16 = [&table](size_t i) {
+			return static_cast<unsigned>((table[i] << 8) | table[i + 1]);
+		};
+
+		// Only version 0 tables are supported, like FreeType
+		if (u16(0) != 0) {
+			return kerning;
+		}
+
+		// Kerning in font units by glyph indices
+		unordered_map<uint64_t, FT_Pos> glyph_kerning;
+
+		size_t offset = 4;
+		for (unsigned int i = 0, tables = u16(2); i < tables && offset + 14 <= length; i++) {
+			unsigned int subtable_length = u16(offset + 2);
+			unsigned int coverage = u16(offset + 4);
+
+			// Horizontal format 0 subtables that are not minimum values or cross-stream
+			if ((coverage & 0xFF07) != 0x0001) {
+				if (subtable_length == 0) {
+					break;
+				}
+				offset += subtable_length;
+				continue;
+			}
+
+			// The 16 bit subtable length overflows in some fonts with many pairs so use the number of pairs
+			size_t pairs = min<size_t>(u16(offset + 6), (length - offset - 14) / 6);
+			offset += 14;
+
+			for (size_t j = 0; j < pairs; j++, offset += 6) {
+				auto& k = glyph_kerning[(static_cast<uint64_t>(u16(offset)) << 32) | u16(offset + 2)];
+				auto value = static_cast<int16_t>(u16(offset + 4));
+
+				// Subtables either add to or override the previous ones
+				k = coverage & 8 ? value : k + value;
+			}
+		}
+
+		if (glyph_kerning.empty()) {
+			return kerning;
+		}
+
+		// A glyph can be used for more than one char code
+		unordered_map<FT_UInt, vector<CharCode>> char_codes;
+		for (auto const& [char_code, glyph_index] : glyphs) {
+			char_codes[glyph_index].push_back(char_code);
+		}
+
+		for (auto const& [glyph_pair, value] : glyph_kerning) {
+			auto left = char_codes.find(static_cast<FT_UInt>(glyph_pair >> 32));
+			auto right = char_codes.find(static_cast<FT_UInt>(glyph_pair & 0xFFFFFFFF));
+
+			if (left == char_codes.end() || right == char_codes.end()) {
+				continue;
+			}
+
+			auto x_64 = static_cast<int32_t>(FT_MulFix(value, face->size->metrics.x_scale));
+
+			for (CharCode l : (*left).second) {
+				for (CharCode r : (*right).second) {
+					kerning.set(l, r, x_64);
+				}
+			}
+		}
+
+		return kerning;
 	}
 
-	Glyph::Glyph(FontFace face_, CharCode c, uint32_t glyph_index)
+	// What the rasterisation threads of a font instance need. They open their own faces (or share the glyph cache)
+	// so other font instances can use the font while they run.
+	struct GlyphJob {
+		string file_path;
+		shared_ptr<MappedFile> mapped_file;
+		FontSize font_size;
+		vector<FT_Fixed> variation_coords;
+		FTC_FaceID cache_face_id;
+		GlyphList to_load;
+	};
+
+	// Renders every glyph of the job at every phase on thread_count threads and adds them to glyphs.
+	// The glyphs are split into contiguous chunks, one per thread, and the results are merged in chunk order so the
+	// output does not depend on thread scheduling. Stops early, adding nothing, if stop is set.
+	static void render_glyphs(GlyphJob const& job, FontInstanceOptions const& options, const unsigned char* coverage_lut, GlyphQuality quality,
+		unsigned int thread_count, vector<CodepointTable<Glyph>>& glyphs, GlyphArena& arena, atomic<bool> const& stop)
 	{
-		auto face = reinterpret_cast<FT_Face>(face_);
+		// Item i is glyph i % to_load.size() at phase i / to_load.size()
+		auto const& to_load = job.to_load;
+		size_t items = to_load.size() * options.subpixel_phases;
 
-		assert_(!FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT));
+		// Each thread has its own arena so that they do not have to synchronise allocations
+		vector<vector<pair<CharCode, Glyph>>> results(thread_count);
+		vector<GlyphArena> arenas(thread_count);
+		vector<exception_ptr> errors(thread_count);
 
-		// FT_RENDER_MODE_NORMAL for 8-bit grey fonts
-		// FT_RENDER_MODE_LCD for RGB fonts for horizontal displays
-		assert_(!FT_Render_Glyph(face->glyph, FT_RENDER_MODE_LCD));
+		auto render_chunk = [&](unsigned int i) {
+			size_t begin = items * i / thread_count;
+			size_t end = items * (i + 1) / thread_count;
 
-		auto bitmap = &face->glyph->bitmap;
+			try {
+				optional<WorkerFace> worker_face;
+				if (!job.cache_face_id) {
+					worker_face.emplace(job.file_path, job.mapped_file.get(), job.font_size, job.variation_coords);
+				}
 
-		// FT_PIXEL_MODE_GRAY for 8-bit grey fonts
-		// FT_PIXEL_MODE_LCD for RGB fonts for horizontal displays
-		assert_(bitmap->pixel_mode == FT_PIXEL_MODE_LCD);
+				auto& out = results[i];
+				out.reserve(end - begin);
+				for (size_t j = begin; j < end && !stop; j++) {
+					auto const& [char_code, glyph_index] = to_load[j % to_load.size()];
+					auto phase = static_cast<unsigned>(j / to_load.size());
+					out.emplace_back(char_code, job.cache_face_id
+						? render_cached_glyph(job.cache_face_id, job.font_size, glyph_index, options, arenas[i], phase, coverage_lut, quality)
+						: Glyph(worker_face->get(), char_code, glyph_index, options, arenas[i], phase, coverage_lut, quality));
+				}
+			}
+			catch (...) {
+				errors[i] = current_exception();
+			}
+		};
 
-		advance = face->glyph->advance.x / 64;
-		bitmap_width = bitmap->width / 3;
-		bitmap_height = bitmap->rows;
-		left = face->glyph->bitmap_left;
-		top = face->glyph->bitmap_top;
+		if (thread_count == 1) {
+			render_chunk(0);
+		}
+		else {
+			vector<thread> threads;
+			threads.reserve(thread_count);
 
-		int pitch = bitmap->pitch; // width in bytes
+			for (unsigned int i = 0; i < thread_count; i++) {
+				threads.emplace_back(render_chunk, i);
+			}
+
+			for (auto& t : threads) {
+				t.join();
+			}
+		}
+
+		for (auto const& e : errors) {
+			if (e) {
+				rethrow_exception(e);
+			}
+		}
+
+		if (stop) {
+			return;
+		}
+
+		for (unsigned int i = 0; i < thread_count; i++) {
+			arena.merge(move(arenas[i]));
+
+			size_t j = items * i / thread_count;
+			for (auto& [char_code, glyph] : results[i]) {
+				glyphs[j++ / to_load.size()].emplace(char_code, move(glyph));
+			}
+		}
+	}
+
+	FontInstance::FontInstance(Font& font, FontSize font_size_, FontInstanceOptions const& options_, bool load)
+		: font_size(font_size_), options(options_)
+	{
+		assert__(options.render_mode != RenderMode::LCD || options.pixel_format != PixelFormat::R8, "LCD glyphs cannot be R8");
+		assert__(options.subpixel_phases >= 1 && options.subpixel_phases <= 64, "Invalid number of subpixel phases");
+		assert__(options.gamma > 0 && options.contrast >= -1 && options.contrast <= 1, "Invalid coverage curve");
+		assert__(options.render_mode != RenderMode::SDF || !options.has_coverage_curve(), "SDF glyphs cannot have a coverage curve");
+		assert__(options.sdf_spread >= 2 && options.sdf_spread <= 32, "Invalid SDF spread");
+		glyphs.resize(options.subpixel_phases);
+
+		if (!load) {
+			data_freed = true;
+			return;
+		}
+
+		if (options.has_coverage_curve()) {
+			coverage_lut = make_coverage_lut(options.gamma, options.contrast);
+		}
+
+		auto face = reinterpret_cast<FT_Face>(font.face.value());
+
+		GlyphList to_load;
+		size_t items;
+		unsigned int thread_count;
+
+		// Progressive font instances start with draft glyphs, which are then replaced on refine_thread
+		auto first_quality = options.progressive && !options.lazy && options.render_mode != RenderMode::SDF
+			? GlyphQuality::Draft : GlyphQuality::Final;
+
+		{
+			// The face is shared by all font instances of the font
+			lock_guard<mutex> face_lock(font.face_mutex);
+
+			// Each font instance has its own size object so that font instances do not change each other's character size.
+			// Destroyed before the face is unlocked unless it is kept for a lazy font instance.
+			FT_Size new_size;
+			assert__(!FT_New_Size(face, &new_size), "Error creating font size");
+			unique_ptr<FT_SizeRec_, FT_Error(*)(FT_Size)> size_owner(new_size, FT_Done_Size);
+
+			FT_Activate_Size(new_size);
+			variation_coords = get_variation_coords(face, options.variation);
+			set_variation(face, font.face_variation, variation_coords);
+			set_char_size(face, font_size);
+
+			if (cache_manager) {
+				lock_guard<mutex> cache_lock(library_mutex);
+				cache_face_id = get_cache_face_id(font.file_path, font.mapped_file, variation_coords);
+			}
+
+			to_load = list_glyphs(face, options.charset);
+
+			kerning = read_kerning(face, to_load);
+
+			if (options.lazy) {
+				// Cached glyphs are loaded with the cache's own faces and sizes
+				if (!cache_face_id) {
+					size = size_owner.release();
+				}
+				lazy_font = font.shared_from_this();
+				return;
+			}
+
+			// Every glyph is rendered once per phase
+			items = to_load.size() * options.subpixel_phases;
+
+
+			thread_count = options.threads ? options.threads : thread::hardware_concurrency();
+			thread_count = max(1u, min(thread_count, static_cast<unsigned>(items / 16)));
+
+			if (thread_count <= 1) {
+				for (unsigned int phase = 0; phase < options.subpixel_phases; phase++) {
+					for (auto const& [char_code, glyph_index] : to_load) {
+						if (cache_face_id) {
+							glyphs[phase].emplace(char_code, render_cached_glyph(cache_face_id, font_size, glyph_index, options, arena, phase,
+								get_coverage_lut(), first_quality));
+						}
+						else {
+							glyphs[phase].emplace(char_code, face, char_code, glyph_index, options, arena, phase, get_coverage_lut(), first_quality);
+						}
+					}
+				}
+			}
+		}
+
+		GlyphJob job = { font.file_path, font.mapped_file, font_size, variation_coords, cache_face_id, move(to_load) };
+
+		if (thread_count > 1) {
+			render_glyphs(job, options, get_coverage_lut(), first_quality, thread_count, glyphs, arena, stop_refining);
+		}
+
+		if (first_quality == GlyphQuality::Draft) {
+			quality = GlyphQuality::Draft;
 
-		assert_(static_cast<unsigned>(pitch) >= bitmap_width * 3);
+			refine_thread = thread([this, job = move(job), thread_count]() {
+				vector<CodepointTable<Glyph>> final_glyphs(options.subpixel_phases);
+				GlyphArena final_arena;
 
-		if (get_bitmap_size_bytes() > 0) {
-			bitmap_data = HeapArray<unsigned char>(get_bitmap_size_bytes());
+				try {
+					render_glyphs(job, options, get_coverage_lut(), GlyphQuality::Final, thread_count, final_glyphs, final_arena, stop_refining);
+				}
+				catch (...) {
+					// The draft glyphs are kept
+					return;
+				}
+
+				unique_lock<shared_mutex> lock(glyphs_mutex);
 
-			unsigned char* dst = bitmap_data.value().get();
-			const unsigned char* src = bitmap->buffer;
-			for (unsigned int y = 0; y < bitmap_height; y++) {
-				for (unsigned int x = 0; x < bitmap_width; x++) {
-					dst[0] = src[x * 3 + 0];
-					dst[1] = src[x * 3 + 1];
-					dst[2] = src[x * 3 + 2];
-					dst[3] = 255;
-					dst += 4;
+				if (stop_refining || data_freed) {
+					return;
 				}
-				src += pitch;
+
+				// The draft glyphs are kept for pointers that were handed out until free_draft_glyphs() is called.
+				// Progressive font instances are never lazy so the arena only has draft bitmaps.
+				draft_glyphs = move(glyphs);
+				draft_arena = move(arena);
+				glyphs = move(final_glyphs);
+				arena = move(final_arena);
+
+				quality = GlyphQuality::Final;
+				glyphs_version++;
+			});
+		}
+	}
+
+	FontInstance::~FontInstance() {
+		stop_refining = true;
+		if (refine_thread.joinable()) {
+			refine_thread.join();
+		}
+
+		release_size();
+	}
+
+	void FontInstance::activate_face(Font& font) {
+		auto face = reinterpret_cast<FT_Face>(font.face.value());
+
+		FT_Activate_Size(reinterpret_cast<FT_Size>(size));
+
+		// The size's scaled metrics and hinting data depend on the variation so they are recalculated if it changed
+		if (set_variation(face, font.face_variation, variation_coords)) {
+			set_char_size(face, font_size);
+		}
+	}
+
+	void FontInstance::release_size() {
+		if (size) {
+			lock_guard<mutex> face_lock(lazy_font->face_mutex);
+			FT_Done_Size(reinterpret_cast<FT_Size>(size));
+			size = nullptr;
+		}
+	}
+
+	// Rounds towards negative infinity. b must be positive.
+	static int64_t floor_div(int64_t a, int64_t b) {
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+	FontInstance::PenPosition FontInstance::get_pen_position(int32_t x_64) const {
+		int64_t phases = options.subpixel_phases;
+
+		// Nearest multiple of 1/phases of a pixel
+		int64_t steps = floor_div(static_cast<int64_t>(x_64) * phases + 32, 64);
+		int64_t x = floor_div(steps, phases);
+
+		return { static_cast<int>(x), static_cast<unsigned>(steps - x * phases) };
+	}
+
+	Glyph const* FontInstance::get_glyph(CharCode char_code, unsigned int phase) {
+		// glyphs is replaced when a progressive font instance is refined, so it is only used with the lock held
+		assert_(phase < options.subpixel_phases);
+
+		{
+			shared_lock<shared_mutex> lock(glyphs_mutex);
+
+			auto existing = glyphs[phase].find(char_code);
+			if (existing || !options.lazy) {
+				return existing;
 			}
+		}
+
+		unique_lock<shared_mutex> lock(glyphs_mutex);
+		auto& phase_glyphs = glyphs[phase];
+
+		// Another thread might have loaded it while this one was waiting for the lock
+		auto existing = phase_glyphs.find(char_code);
+		if (existing) {
+			return existing;
+		}
 
+		if (lazy_font == nullptr || char_code == 0 || char_code > CodepointTable<Glyph>::MAX_CHAR_CODE
+			|| !options.charset.contains(char_code) || missing_glyphs.count(char_code)) {
+			return nullptr;
 		}
+
+		if (cache_face_id) {
+			FT_UInt glyph_index;
+			{
+				lock_guard<mutex> cache_lock(library_mutex);
+				glyph_index = FTC_CMapCache_Lookup(cmap_cache, cache_face_id, -1, char_code);
+			}
+
+			if (glyph_index == 0) {
+				missing_glyphs.insert(char_code);
+				return nullptr;
+			}
+
+			return &phase_glyphs.emplace(char_code, render_cached_glyph(cache_face_id, font_size, glyph_index, options, arena, phase, get_coverage_lut()));
+		}
+
+		auto face = reinterpret_cast<FT_Face>(lazy_font->face.value());
+
+		lock_guard<mutex> face_lock(lazy_font->face_mutex);
+
+		activate_face(*lazy_font);
+
+		auto glyph_index = FT_Get_Char_Index(face, char_code);
+		if (glyph_index <= 0) {
+			missing_glyphs.insert(char_code);
+			return nullptr;
+		}
+
+		return &phase_glyphs.emplace(char_code, face, char_code, glyph_index, options, arena, phase, get_coverage_lut());
 	}
 
-	void Glyph::free_data() {
-		if (bitmap_data.has_value()) {
-			bitmap_data = nullopt;
+	void FontInstance::free_data() {
+		// The glyphs would be thrown away
+		stop_refining = true;
+
+		unique_lock<shared_mutex> lock(glyphs_mutex);
+
+		release_size();
+		lazy_font = nullptr;
+		data_freed = true;
+		for (auto& phase_glyphs : glyphs) {
+			for (auto [_, glyph] : phase_glyphs) {
+				glyph.free_data();
+			}
+		}
+		for (auto& phase_glyphs : draft_glyphs) {
+			for (auto [_, glyph] : phase_glyphs) {
+				glyph.free_data();
+			}
+		}
+		arena.clear();
+		draft_arena.clear();
+	}
+
+	void FontInstance::free_draft_glyphs() {
+		unique_lock<shared_mutex> lock(glyphs_mutex);
+
+		draft_glyphs = vector<CodepointTable<Glyph>>();
+		draft_arena.clear();
+	}
+
+	size_t FontInstance::get_memory_usage() const {
+		shared_lock<shared_mutex> lock(glyphs_mutex);
+
+		size_t bytes = arena.get_allocated_bytes() + draft_arena.get_allocated_bytes();
+		for (auto const& phase_glyphs : glyphs) {
+			bytes += phase_glyphs.size() * sizeof(Glyph);
+		}
+		for (auto const& phase_glyphs : draft_glyphs) {
+			bytes += phase_glyphs.size() * sizeof(Glyph);
+		}
+		return bytes;
+	}
+
+	Glyph::Glyph(FontFace face_, CharCode c, uint32_t glyph_index, FontInstanceOptions const& options, GlyphArena& arena, unsigned int phase,
+		const unsigned char* coverage_lut, GlyphQuality quality_)
+		: format(options.get_glyph_pixel_format()), quality(quality_)
+	{
+		auto face = reinterpret_cast<FT_Face>(face_);
+
+		assert_(!FT_Load_Glyph(face, glyph_index, get_load_flags(options, quality)));
+
+		// Bitmap glyphs cannot be changed so every phase is the same
+		FT_Pos extra_advance = 0;
+		if (face->glyph->format == FT_GLYPH_FORMAT_OUTLINE) {
+			extra_advance = apply_synthetic_style(&face->glyph->outline, get_bold_strength(face->size), options);
+
+			if (phase) {
+				FT_Outline_Translate(&face->glyph->outline, static_cast<FT_Pos>(phase * 64 / options.subpixel_phases), 0);
+			}
 		}
+
+		auto render_mode = get_render_mode(options, quality);
+
+		// FT_RENDER_MODE_NORMAL for 8-bit grey fonts
+		// FT_RENDER_MODE_LCD for RGB fonts for horizontal displays
+		// FT_RENDER_MODE_SDF for distance fields
+		assert_(!render_glyph(face->glyph->library, render_mode, options.sdf_spread, [face](FT_Render_Mode ft_render_mode) {
+			return FT_Render_Glyph(face->glyph, ft_render_mode);
+		}));
+
+		advance = static_cast<unsigned>((face->glyph->advance.x + extra_advance) / 64);
+		advance_64 = static_cast<unsigned>(((face->glyph->linearHoriAdvance + 512) >> 10) + extra_advance); // 16.16 -> 26.6
+		left = face->glyph->bitmap_left;
+		top = face->glyph->bitmap_top;
+
+		copy_bitmap(*this, &face->glyph->bitmap, render_mode, arena, coverage_lut);
 	}
 
-	Glyph::~Glyph() {
-		free_data();
+	void Glyph::free_data() {
+		bitmap_data = nullptr;
+	}
+
+	Glyph Glyph::copy_to(GlyphArena& arena) const {
+		Glyph copy;
+		copy.advance = advance;
+		copy.advance_64 = advance_64;
+		copy.bitmap_width = bitmap_width;
+		copy.bitmap_height = bitmap_height;
+		copy.left = left;
+		copy.top = top;
+		copy.format = format;
+		copy.quality = quality;
+
+		if (bitmap_data) {
+			copy.bitmap_data = arena.allocate(get_bitmap_size_bytes());
+			memcpy(copy.bitmap_data, bitmap_data, get_bitmap_size_bytes());
+		}
+
+		return copy;
 	}
 }
@@ -3,10 +3,25 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <set>
 #include <optional>
 #include <vector>
 #include <cstdint>
+#include <tuple>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <functional>
 #include "HeapArray.h"
+#include "GlyphArena.h"
+#include "CodepointTable.h"
+#include "KerningTable.h"
+#include "MappedFile.h"
+#include "WeakRegistry.h"
+#include "Charset.h"
 
 namespace SubPixelFonts {
 
@@ -14,38 +29,192 @@ namespace SubPixelFonts {
 	// Font instances store all glyph data for a font with a given size
 	// Font instances can continue to exist after the font object has been freed. They are fully independent.
 	// Font objects cache weak pointers to font instances.
+	// Fonts, font instances and cached texture atlases can be loaded from several threads at once.
 
 
-	using CharCode = uint32_t;
 	using FontFace = void*; // FT_Face
+	using FontFaceSize = void*; // FT_Size
 	using FontHeight = unsigned int; // pixels
 
+	// Font size in points and the resolution of the display it is drawn on.
+	// Font instances are cached by the pixel size this works out to, so equivalent sizes (e.g. 12pt at 96 dpi and
+	// 9pt at 128 dpi) share a font instance. Use a dpi of 96 * scale factor for scaled displays (120 for 1.25x, 144 for 1.5x).
+	struct FontSize {
+		uint32_t points_64 = 0; // 1/64ths of a point
+		unsigned int dpi = 96;
+
+		FontSize() {}
+		FontSize(uint32_t points_64_, unsigned int dpi_) : points_64(points_64_), dpi(dpi_) {}
+
+		// Pixel heights are sizes at 96 dpi
+		FontSize(FontHeight height_in_pixels) : points_64(height_in_pixels * 48), dpi(96) {}
+
+		static FontSize from_points(double points, unsigned int dpi) {
+			return FontSize(static_cast<uint32_t>(points * 64 + 0.5), dpi);
+		}
+
+		// Height of the em square in 1/64ths of a pixel, rounded the same way as FreeType
+		uint32_t get_pixels_64() const {
+			return static_cast<uint32_t>((static_cast<uint64_t>(points_64) * dpi + 36) / 72);
+		}
+
+		bool operator<(FontSize const& other) const {
+			return get_pixels_64() < other.get_pixels_64();
+		}
+
+		bool operator==(FontSize const& other) const {
+			return get_pixels_64() == other.get_pixels_64();
+		}
+	};
+
+	// Layout of glyph bitmaps and texture atlas images
+	// Rows are tightly packed so set GL_UNPACK_ALIGNMENT to 1 before uploading RGB8 and R8 images.
+	enum class PixelFormat : uint8_t {
+		RGBA8, // Alpha is always 255
+		RGB8, // 25% smaller
+		R8, // Grayscale glyphs only
+	};
+
+	inline unsigned int get_bytes_per_pixel(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::RGB8:
+			return 3;
+		case PixelFormat::R8:
+			return 1;
+		default:
+			return 4;
+		}
+	}
+
+	enum class RenderMode : uint8_t {
+		// Subpixel antialiasing for horizontal RGB displays
+		LCD,
+
+		// Regular antialiasing, 1 byte per pixel. For rotated text and high DPI displays where subpixel rendering does not help.
+		// Draw with FONT_FRAGMENT_SHADER_GRAYSCALE_GL3 if the texture atlas is R8. Grayscale glyphs in RGB(A) atlases
+		// have the coverage copied to all 3 colour channels so the regular shader works.
+		Grayscale,
+
+		// Signed distance field, 1 byte per pixel, for text that is drawn at many sizes (zoomable maps, text in 3D scenes).
+		// 128 is the outline and values go up towards the inside of the glyph, reaching 0 or 255 sdf_spread pixels from it.
+		// Glyphs are unhinted and have sdf_spread pixels of padding around the outline, which left and top include.
+		// Scale the quads by draw size / font size and draw with FONT_FRAGMENT_SHADER_SDF_GL3 and linear filtering.
+		SDF,
+	};
+
+	// See FontInstanceOptions::progressive
+	enum class GlyphQuality : uint8_t {
+		Draft, // Rendered without hinting. LCD glyphs are rendered in grayscale.
+		Final,
+	};
+
+	struct FontInstanceOptions {
+		// Number of threads used to rasterise the glyphs. 0 = one per hardware thread.
+		// Each thread opens its own copy of the font file as FreeType faces cannot be shared between threads.
+		unsigned int threads = 1;
+
+		// If true then no glyphs are rasterised up front. Each glyph is rasterised the first time it is
+		// requested with FontInstance::get_glyph(..) and char codes the font does not have are remembered.
+		// A texture atlas only contains the glyphs that had been requested before it was created.
+		bool lazy = false;
+
+		// Char codes to load. Lazy font instances will not load glyphs outside of this set either.
+		Charset charset = Charset::latin1();
+
+		RenderMode render_mode = RenderMode::LCD;
+
+		// Format of Glyph::bitmap_data for LCD glyphs, which must be RGBA8 or RGB8. Does not have to match the format of the
+		// texture atlas. Grayscale and SDF glyphs are always R8, so R8 is only valid for those render modes.
+		PixelFormat pixel_format = PixelFormat::RGBA8;
+
+		// Number of horizontal subpixel positions each glyph is rendered at. Phase p is shifted right by p / subpixel_phases pixels.
+		// Memory use and rasterisation time are multiplied by this. Values above 1 use light (vertical only) hinting
+		// so that the phases of a glyph have the same shape. See FontInstance::get_pen_position(..).
+		unsigned int subpixel_phases = 1;
+
+		// Design coordinates of a variable font by axis tag, e.g. {{"wght", 700}, {"wdth", 75}, {"opsz", 12}}.
+		// Axes that are not listed use the font's default. Values are clamped to the axis range.
+		// Throws std::runtime_error when the font instance is created if the font is not a variable font or does not have an axis.
+		std::map<std::string, double> variation;
+
+		// Synthetic styles for when there is no bold or italic font file. Applied to the outlines before rasterisation,
+		// the same way as FreeType's FT_GlyphSlot_Embolden and FT_GlyphSlot_Oblique. Bitmap fonts are not changed.
+		bool synthetic_bold = false; // Thickens strokes by 1/24 of the em and widens advances by the same amount
+		bool synthetic_oblique = false; // Slants glyphs right by about 12 degrees
+
+		// Curve applied to the coverage values of the glyph bitmaps when they are created, so shaders do not have to.
+		// Coverage c (0 to 1) becomes pow(c, 1 / gamma), then contrast moves it towards smoothstep(c):
+		// c + contrast * (c * c * (3 - 2 * c) - c). Gamma above 1 makes text heavier, contrast above 0 makes edges sharper.
+		// gamma must be positive and contrast between -1 and 1. The defaults leave the coverage unchanged. Cannot be used with SDF glyphs.
+		double gamma = 1.0;
+		double contrast = 0.0;
+
+		// Distance in pixels at the font size that the SDF render mode's values reach 0 or 255. Between 2 and 32.
+		// Larger spreads allow bigger scale factors and effects such as outlines, at the cost of atlas space.
+		unsigned int sdf_spread = 8;
+
+		// If true then the glyphs are first rendered without hinting, and LCD glyphs in grayscale, which is about twice as
+		// quick, so that text can be drawn sooner.
+		// A background thread then renders them again at full quality and replaces them in one go. Glyph pointers taken
+		// before that stay valid and keep pointing at the draft glyphs, which stay in memory as well (so the font instance
+		// uses about twice the memory) until FontInstance::free_draft_glyphs(). See FontInstance::get_quality().
+		// Not used by lazy font instances or SDF glyphs, which are never hinted.
+		bool progressive = false;
+
+		bool has_coverage_curve() const {
+			return gamma != 1.0 || contrast != 0.0;
+		}
+
+		PixelFormat get_glyph_pixel_format() const {
+			return render_mode == RenderMode::LCD ? pixel_format : PixelFormat::R8;
+		}
+
+		// Only compares the options that change the contents of the font instance
+		bool operator<(FontInstanceOptions const& other) const {
+			return std::tie(lazy, charset, render_mode, pixel_format, subpixel_phases, variation, synthetic_bold, synthetic_oblique, gamma, contrast,
+				sdf_spread, progressive)
+				< std::tie(other.lazy, other.charset, other.render_mode, other.pixel_format, other.subpixel_phases, other.variation,
+					other.synthetic_bold, other.synthetic_oblique, other.gamma, other.contrast, other.sdf_spread, other.progressive);
+		}
+	};
+
 	struct Glyph {
 
 		// How far to move cursor after drawing glyph
 		unsigned int advance = 0;
 
-		std::optional<HeapArray<unsigned char>> bitmap_data = std::nullopt;
+		// Unrounded advance in 1/64ths of a pixel. Use with subpixel phases so that rounding errors do not add up along a line.
+		unsigned int advance_64 = 0;
+
+		// Owned by the font instance's GlyphArena. nullptr if the glyph is invisible or the font instance data has been freed.
+		unsigned char* bitmap_data = nullptr;
 
 		// If either of these is 0 then the glyph is invisible (space character etc.)
 		unsigned int bitmap_width = 0;
 		unsigned int bitmap_height = 0;
 
-		// Position of glyph relative to baseline
+		// Position of glyph relative to baseline. The bitmap is trimmed to its inked pixels.
 		int left = 0;
 		int top = 0;
 
+		PixelFormat format = PixelFormat::RGBA8;
+
+		GlyphQuality quality = GlyphQuality::Final;
+
 		Glyph() {} // Blank glyph
-		Glyph(FontFace, CharCode, uint32_t glyph_index);
-		~Glyph();
+		// The bitmap is allocated from arena. If coverage_lut is not nullptr then every byte of the bitmap is replaced with coverage_lut[byte].
+		Glyph(FontFace, CharCode, uint32_t glyph_index, FontInstanceOptions const&, GlyphArena& arena, unsigned int phase = 0,
+			const unsigned char* coverage_lut = nullptr, GlyphQuality = GlyphQuality::Final);
 
-		unsigned int get_bitmap_size_bytes() {
-			// rgba, alpha always 1
-			return bitmap_width * bitmap_height * 4;
+		unsigned int get_bitmap_size_bytes() const {
+			return bitmap_width * bitmap_height * get_bytes_per_pixel(format);
 		}
 
 		void free_data();
 
+		// Copies the glyph and its bitmap into arena
+		Glyph copy_to(GlyphArena& arena) const;
+
 		/*Glyph(const Glyph& other) {
 			memcpy(this, &other, sizeof(Glyph));
 			if (bitmap_data) {
@@ -60,42 +229,197 @@ namespace SubPixelFonts {
 		Glyph& operator=(Glyph&& other) = default;
 	};
 
+	// See Font::get_cache_stats()
+	struct FontCacheStats {
+		// Font::load(..) and Font::load_font_instance(..) calls that returned an existing object (hits)
+		// or had to create one (misses). Font instances of every font are counted together.
+		uint64_t font_hits = 0;
+		uint64_t font_misses = 0;
+		uint64_t instance_hits = 0;
+		uint64_t instance_misses = 0;
+
+		// Fonts and font instances held by the keep-alive cache, see Font::set_keep_alive(..)
+		size_t kept_alive = 0;
+		size_t kept_alive_bytes = 0;
+	};
+
 	class TextureAtlas;
+	class Font;
 	class FontInstance {
 		friend class TextureAtlas;
+		friend class FontFallbackChain;
 	public:
-		FontInstance(FontFace, FontHeight height_in_pixels, bool load = true); // Do not call this. Use Font.load_font_instance(..)
+		// Do not call this. Use Font.load_font_instance(..)
+		FontInstance(Font&, FontSize, FontInstanceOptions const&, bool load = true);
+		~FontInstance();
+
+		// Returns nullptr if the font does not have a glyph for the char code
+		// Lazy font instances rasterise the glyph if it has not been requested before
+		// phase must be less than FontInstanceOptions::subpixel_phases
+		// Thread-safe, but for many lookups it is faster to use the glyph maps of a texture atlas which do not need locking
+		Glyph const* get_glyph(CharCode, unsigned int phase = 0);
+
+		// Amount to move the pen by between left and right, in 1/64ths of a pixel. Use (x + 32) >> 6 for whole pixels.
+		// Read from the font's TrueType 'kern' table when the font instance is created, so it is also available for
+		// font instances loaded from a texture atlas cache. Kerning that is only in the OpenType GPOS table is not supported.
+		int32_t get_kerning(CharCode left, CharCode right) const {
+			return kerning.get(left, right);
+		}
+
+		KerningTable const& get_kerning_table() const {
+			return kerning;
+		}
+
+		struct PenPosition {
+			int x; // Whole pixels
+			unsigned int phase; // Subpixel phase of the glyph to draw at x
+		};
+
+		// Rounds a pen position in 1/64ths of a pixel (e.g. the sum of Glyph::advance_64) to the nearest subpixel phase
+		PenPosition get_pen_position(int32_t x_64) const;
+
+		FontInstanceOptions const& get_options() const {
+			return options;
+		}
+
+		FontSize get_size() const {
+			return font_size;
+		}
 
+		// Also stops lazy font instances from loading any more glyphs
+		// Do not call this while a texture atlas is being created from this font instance
 		void free_data();
+
+		// Approximate memory used by the glyphs
+		size_t get_memory_usage() const;
+
+		// Frees the draft glyphs of a progressive font instance once they have been replaced (see get_quality()).
+		// Only call this when no texture atlas made before then is used, and no glyph pointers taken before then.
+		void free_draft_glyphs();
+
+		// Draft until the glyphs of a progressive font instance have been replaced with full quality ones.
+		// Texture atlases made before then keep the draft glyphs, see TextureAtlas::is_outdated().
+		GlyphQuality get_quality() const {
+			return quality;
+		}
+
+		// Number of times the glyphs have been replaced
+		unsigned int get_glyphs_version() const {
+			return glyphs_version;
+		}
 	private:
 		// If so then texture atlasses cannot be created using this font
 		bool data_freed = false;
 
-		std::map<CharCode, Glyph> glyphs; // ASCII code -> glyph
+		std::vector<CodepointTable<Glyph>> glyphs; // [subpixel phase] char code -> glyph
+
+		// Protects glyphs, arena, draft_glyphs, draft_arena, missing_glyphs, kerning and lazy_font after the constructor has finished.
+		// Glyphs never move once created so pointers to them can be used without the lock.
+		mutable std::shared_mutex glyphs_mutex;
+
+		GlyphArena arena; // Glyph bitmaps, except those of draft_glyphs
+
+		KerningTable kerning; // Pairs of char codes in the charset. Not freed by free_data().
+
+		FontSize font_size;
+
+		// Lazy font instances keep the font alive so that glyphs can be loaded later
+		std::shared_ptr<Font> lazy_font = nullptr;
+		FontFaceSize size = nullptr; // Character size of lazy font instances, belongs to lazy_font's face
+		void release_size();
+
+		// Design coordinates (FT_Fixed) of every axis for variable fonts, empty for other fonts
+		std::vector<long> variation_coords;
+
+		void* cache_face_id = nullptr; // FTC_FaceID for the file and variation if the glyph cache is enabled
+
+		std::vector<unsigned char> coverage_lut; // 256 entries, empty if FontInstanceOptions::has_coverage_curve() is false
+
+		const unsigned char* get_coverage_lut() const {
+			return coverage_lut.empty() ? nullptr : coverage_lut.data();
+		}
+
+		// Makes the font's face use this font instance's size and variation. The face must be locked.
+		void activate_face(Font&);
+		std::set<CharCode> missing_glyphs; // Char codes already looked up and not in the font
+
+		FontInstanceOptions options;
+
+		// Progressive font instances
+		std::atomic<GlyphQuality> quality{ GlyphQuality::Final };
+		std::atomic<unsigned int> glyphs_version{ 0 };
+		std::vector<CodepointTable<Glyph>> draft_glyphs; // Replaced glyphs, kept for pointers that were handed out
+		GlyphArena draft_arena; // Bitmaps of draft_glyphs
+		std::atomic<bool> stop_refining{ false };
+		std::thread refine_thread;
 	};
 
 
-	class Font {
+	class Font : public std::enable_shared_from_this<Font> {
 		friend class FontInstance;
 		friend struct Glyph;
 	public:
 		// !! Must be called before creating any fonts !!
-		static void init();
+		// If glyph_cache_bytes is not 0 then glyphs are loaded through FreeType's cache subsystem (FTC), which keeps
+		// loaded outlines and char map lookups in memory up to that many bytes. Font instances that are created again
+		// after being freed (and lazy font instances) reuse the outlines instead of loading them from the font again.
+		static void init(size_t glyph_cache_bytes = 0);
 
 		// Call before application quits
 		static void deinit();
 
+		// Fonts and font instances are normally destroyed as soon as nothing uses them, so loading them again opens the
+		// file and rasterises every glyph again. With a keep-alive budget the most recently loaded ones stay in memory
+		// until they are max_age old (since they were last loaded) or newer ones need the space. max_bytes counts font
+		// files and glyph bitmaps. A kept alive font instance also keeps its font. Objects bigger than max_bytes are not kept.
+		// 0 (the default) turns it off and releases everything that is being kept alive.
+		static void set_keep_alive(size_t max_bytes,
+			std::chrono::steady_clock::duration max_age = std::chrono::steady_clock::duration::max());
+
+		// Releases kept alive objects that are older than max_age. Call regularly (e.g. once per frame) if max_age is used,
+		// otherwise they are only released when fonts or font instances are loaded.
+		static void prune_keep_alive();
+
+		static FontCacheStats get_cache_stats();
+
 		// If load is false then the font object will be created but the .ttf file won't actually be loaded
 		// ^ That is used when loading cached texture atlasses
-		static std::shared_ptr<Font> load(std::string const& file_path, bool load = true);
+		// If memory_map is true then the file is memory mapped instead of read by FreeType. The mapping is shared by every
+		// Font object and rasterisation thread using the file, and the operating system shares the pages between processes.
+		// Use this for large (e.g. CJK) fonts. Only used if the font is not already loaded.
+		static std::shared_ptr<Font> load(std::string const& file_path, bool load = true, bool memory_map = false);
 
-		Font(std::string const& file_path, bool load = true); // Do not call this. Use the static factory function load(..)
+		// Loads the fonts and creates their font instances on background threads (one per font file) so that the calling
+		// thread can carry on, e.g. to show a first frame. The font instances are in the same order as fonts_to_load.
+		// The returned font instances keep their fonts alive, so while they are alive (or kept alive, see set_keep_alive(..))
+		// load(..) and load_font_instance(..) return them without loading them again. Until they are created,
+		// load_font_instance(..) waits for them if it asks for the same font instance.
+		// If on_loaded is set it is called on a background thread once every font instance has loaded. If loading
+		// throws then on_loaded is not called and the future rethrows the exception.
+		// The future's destructor waits for the loading to finish. Do not call deinit() before then, or while the returned
+		// font instances are alive.
+		static std::future<std::vector<std::shared_ptr<FontInstance>>> prefetch(
+			std::vector<std::pair<std::string, FontSize>> const& fonts_to_load, FontInstanceOptions const& = FontInstanceOptions(),
+			std::function<void(std::vector<std::shared_ptr<FontInstance>> const&)> on_loaded = nullptr);
+
+		// Do not call this. Use the static factory function load(..)
+		Font(std::string const& file_path, bool load = true, bool memory_map = false);
 
 		// If load is false then no glyphs will be loaded (used for loading from texture atlas cache)
-		std::shared_ptr<FontInstance> load_font_instance(FontHeight height_in_pixels, bool load = true);
+		// Font instances are cached by pixel size and the options that affect their contents (see FontInstanceOptions::operator<)
+		// Pixel heights convert to FontSize implicitly.
+		std::shared_ptr<FontInstance> load_font_instance(FontSize, bool load = true,
+			FontInstanceOptions const& = FontInstanceOptions());
 
 		~Font();
 
+		std::string const& get_file_path() const {
+			return file_path;
+		}
+
+		// Size of the font file if it has been loaded
+		size_t get_memory_usage() const;
+
 		Font(const Font&) = delete;
 		Font& operator=(const Font&) = delete;
 
@@ -103,9 +427,21 @@ namespace SubPixelFonts {
 		Font& operator=(Font&&) = delete;
 	private:
 
+		std::string file_path;
+
+		std::shared_ptr<MappedFile> mapped_file = nullptr; // If memory mapped. Must outlive face.
+
 		std::optional<FontFace> face = std::nullopt; // Initialised in constructor
 
-		std::map<FontHeight, std::weak_ptr<FontInstance>> instances;
+		// Variation last set on face by a font instance. Faces are shared by font instances with different variations.
+		std::vector<long> face_variation;
+
+		// FreeType faces cannot be used by more than one thread at a time. Lock this before using face.
+		// Font instances have their own FT_Size objects so they only hold this while using the face, and
+		// activate their size and variation before loading glyphs.
+		std::mutex face_mutex;
+
+		WeakRegistry<std::pair<FontSize, FontInstanceOptions>, FontInstance> instances;
 	};
 
 }
@@ -0,0 +1,110 @@
+#include "FontFallbackChain.h"
+#include "Assert.h"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+namespace SubPixelFonts {
+
+	FontFallbackChain::FontFallbackChain(vector<shared_ptr<Font>> const& fonts_, FontSize size_, FontInstanceOptions const& options_)
+		: fonts(fonts_), size(size_), options(options_)
+	{
+		assert__(!fonts.empty(), "Font fallback chain has no fonts");
+
+		for (auto const& font : fonts) {
+			font_instances.push_back(font->load_font_instance(size, true, options));
+		}
+	}
+
+	int FontFallbackChain::resolve(CharCode char_code) {
+		{
+			shared_lock<shared_mutex> lock(resolved_mutex);
+
+			auto font_index = resolved.find(char_code);
+			if (font_index) {
+				return *font_index == NO_FONT ? -1 : static_cast<int>(*font_index);
+			}
+		}
+
+		unsigned int font_index = NO_FONT;
+		for (unsigned int i = 0; i < font_instances.size(); i++) {
+			if (font_instances[i]->get_glyph(char_code)) {
+				font_index = i;
+				break;
+			}
+		}
+
+		if (char_code <= CodepointTable<unsigned int>::MAX_CHAR_CODE) {
+			unique_lock<shared_mutex> lock(resolved_mutex);
+			resolved.emplace(char_code, font_index);
+		}
+
+		return font_index == NO_FONT ? -1 : static_cast<int>(font_index);
+	}
+
+	Glyph const* FontFallbackChain::get_glyph(CharCode char_code, unsigned int phase) {
+		int font_index = resolve(char_code);
+		return font_index < 0 ? nullptr : font_instances[font_index]->get_glyph(char_code, phase);
+	}
+
+	string FontFallbackChain::get_cache_name() const {
+		string name;
+		for (auto const& font : fonts) {
+			if (!name.empty()) {
+				name += '|';
+			}
+			name += font->get_file_path();
+		}
+		return name;
+	}
+
+	shared_ptr<FontInstance> FontFallbackChain::build_font_instance() {
+		// Every char code that any of the font instances has a glyph for
+		vector<CharCode> char_codes;
+		for (auto const& font_instance : font_instances) {
+			shared_lock<shared_mutex> lock(font_instance->glyphs_mutex);
+
+			for (auto [char_code, _] : font_instance->glyphs[0]) {
+				char_codes.push_back(char_code);
+			}
+		}
+
+		sort(char_codes.begin(), char_codes.end());
+		char_codes.erase(unique(char_codes.begin(), char_codes.end()), char_codes.end());
+
+		// Not cached by the font so that it cannot be mixed up with a font instance loaded from a texture atlas cache
+		auto merged_options = options;
+		merged_options.lazy = false;
+
+		auto font = Font::load(get_cache_name(), false);
+		auto merged = make_shared<FontInstance>(*font, size, merged_options, false);
+		merged->data_freed = false;
+
+		for (CharCode char_code : char_codes) {
+			int font_index = resolve(char_code);
+			if (font_index < 0) {
+				continue;
+			}
+
+			for (unsigned int phase = 0; phase < options.subpixel_phases; phase++) {
+				auto glyph = font_instances[font_index]->get_glyph(char_code, phase);
+				if (glyph) {
+					merged->glyphs[phase].emplace(char_code, glyph->copy_to(merged->arena));
+				}
+			}
+		}
+
+		for (unsigned int i = 0; i < font_instances.size(); i++) {
+			for (auto const& pair : font_instances[i]->get_kerning_table().get_pairs()) {
+				if (merged->glyphs[0].contains(pair.left) && merged->glyphs[0].contains(pair.right)
+					&& resolve(pair.left) == static_cast<int>(i) && resolve(pair.right) == static_cast<int>(i)) {
+					merged->kerning.set(pair.left, pair.right, pair.x_64);
+				}
+			}
+		}
+
+		return merged;
+	}
+}
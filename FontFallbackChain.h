@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <shared_mutex>
+#include "Font.h"
+#include "CodepointTable.h"
+
+namespace SubPixelFonts {
+
+	// A primary font with ordered fallback fonts, all at the same size and options.
+	// Each char code comes from the first font that has it. The decision is made once per char code and
+	// remembered in a CodepointTable, so looking up glyphs does not search the fonts again.
+	// Thread-safe.
+
+	class FontFallbackChain {
+	public:
+		// fonts[0] is the primary font. Every font must have been loaded with Font::load(..) with load = true.
+		FontFallbackChain(std::vector<std::shared_ptr<Font>> const& fonts, FontSize, FontInstanceOptions const& = FontInstanceOptions());
+
+		// Index of the font that supplies the char code. -1 if none of the fonts have it.
+		// Lazy font instances rasterise the glyphs they are asked about.
+		int resolve(CharCode);
+
+		// Returns nullptr if none of the fonts have the char code
+		Glyph const* get_glyph(CharCode, unsigned int phase = 0);
+
+		std::shared_ptr<FontInstance> const& get_font_instance(unsigned int font_index) const {
+			return font_instances[font_index];
+		}
+
+		size_t get_font_count() const {
+			return font_instances.size();
+		}
+
+		// File paths of the fonts joined with '|'. Use this as the font path when loading a cached texture
+		// atlas that was created from build_font_instance().
+		std::string get_cache_name() const;
+
+		// Creates a font instance holding a copy of the glyph every char code resolves to, so a texture atlas made
+		// from it has the mixed glyphs in a single glyph map. Kerning is kept for pairs of char codes from the same font.
+		// Lazy font instances only contribute glyphs that have already been requested.
+		std::shared_ptr<FontInstance> build_font_instance();
+	private:
+		std::vector<std::shared_ptr<Font>> fonts;
+		std::vector<std::shared_ptr<FontInstance>> font_instances;
+
+		FontSize size;
+		FontInstanceOptions options;
+
+		static constexpr unsigned int NO_FONT = ~0u;
+
+		CodepointTable<unsigned int> resolved; // char code -> font index or NO_FONT
+		std::shared_mutex resolved_mutex;
+	};
+}
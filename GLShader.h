@@ -36,6 +36,83 @@ out vec3 out_colour;
 void main() {
 	out_colour = texture(tex, vec3(pass_font_tex_coord.xy / vec2(textureSize(tex, 0).xy), pass_font_tex_coord.z)).rgb;}
 
+)";
+
+
+	// For R8 texture atlases (grayscale glyphs). Use with FONT_VERTEX_SHADER_GL3.
+	const char* const FONT_FRAGMENT_SHADER_GRAYSCALE_GL3 = R"(
+#version 130
+
+uniform sampler2DArray tex;
+
+in vec3 pass_font_tex_coord;
+
+out vec3 out_colour;
+
+void main() {
+	out_colour = vec3(texture(tex, vec3(pass_font_tex_coord.xy / vec2(textureSize(tex, 0).xy), pass_font_tex_coord.z)).r);}
+
+)";
+
+
+	// For SDF glyphs (RenderMode::SDF) in R8 texture atlases. Use with FONT_VERTEX_SHADER_GL3 and GL_LINEAR filtering.
+	// The edge is antialiased over one screen pixel whatever scale the glyphs are drawn at.
+	const char* const FONT_FRAGMENT_SHADER_SDF_GL3 = R"(
+#version 130
+
+uniform sampler2DArray tex;
+
+in vec3 pass_font_tex_coord;
+
+out vec3 out_colour;
+
+void main() {
+	float distance = texture(tex, vec3(pass_font_tex_coord.xy / vec2(textureSize(tex, 0).xy), pass_font_tex_coord.z)).r - 0.5;
+	float screen_pixel = length(vec2(dFdx(distance), dFdy(distance)));
+	out_colour = vec3(clamp(distance / max(screen_pixel, 1e-6) + 0.5, 0.0, 1.0));}
+
+)";
+
+
+	// For channel packed texture atlases. in_font_channel is AtlasGlyph::bitmap_channel.
+	const char* const FONT_VERTEX_SHADER_CHANNEL_PACKED_GL3 = R"(
+#version 130
+
+uniform vec2 window_size;
+
+in vec2 in_position; // window coordinates, 0,0 = top left
+in vec3 in_font_tex_coord; // texture coordinates, 0,0,0 = top left first image
+in float in_font_channel; // 0 = red, 1 = green, 2 = blue, 3 = alpha
+
+out vec3 pass_font_tex_coord;
+flat out vec4 pass_channel_mask;
+
+void main() {
+	vec2 c = (in_position / window_size);
+	c.y = 1.0 - c.y;
+	c = c * 2.0 - 1.0;
+	gl_Position = vec4(c, 0.0, 1.0);
+
+	pass_font_tex_coord = in_font_tex_coord;
+	pass_channel_mask = vec4(equal(vec4(in_font_channel), vec4(0.0, 1.0, 2.0, 3.0)));
+}
+
+)";
+
+
+	const char* const FONT_FRAGMENT_SHADER_CHANNEL_PACKED_GL3 = R"(
+#version 130
+
+uniform sampler2DArray tex;
+
+in vec3 pass_font_tex_coord;
+flat in vec4 pass_channel_mask;
+
+out vec3 out_colour;
+
+void main() {
+	out_colour = vec3(dot(texture(tex, vec3(pass_font_tex_coord.xy / vec2(textureSize(tex, 0).xy), pass_font_tex_coord.z)), pass_channel_mask));}
+
 )";
 
 }
\ No newline at end of file
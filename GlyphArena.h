@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include "HeapArray.h"
+
+namespace SubPixelFonts {
+
+	// Bump allocator for glyph bitmaps.
+	// Memory is taken from large blocks and is only released all at once by clear() or the destructor.
+	// Pointers stay valid when the arena is moved or merged into another arena.
+
+	class GlyphArena {
+	public:
+		GlyphArena() {}
+
+		unsigned char* allocate(uintptr_t bytes) {
+			if (blocks.empty() || blocks.back().size() - used < bytes) {
+				// Block sizes double so small font instances do not waste much memory and large ones do few allocations
+				next_block_size = std::min(next_block_size * 2, MAX_BLOCK_SIZE);
+				blocks.emplace_back(std::max(next_block_size, bytes));
+				used = 0;
+			}
+
+			unsigned char* p = blocks.back().get() + used;
+			used += bytes;
+			return p;
+		}
+
+		// Takes ownership of all memory allocated by other.
+		// Allocation continues from other's last block, so the unused end of this arena's last block is wasted.
+		void merge(GlyphArena&& other) {
+			if (other.blocks.empty()) {
+				return;
+			}
+
+			blocks.insert(blocks.end(), std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+			used = other.used;
+			next_block_size = std::max(next_block_size, other.next_block_size);
+
+			other.clear();
+		}
+
+		void clear() {
+			blocks = std::vector<HeapArray<unsigned char>>();
+			used = 0;
+			next_block_size = MIN_BLOCK_SIZE / 2;
+		}
+
+		uintptr_t get_allocated_bytes() const {
+			uintptr_t total = 0;
+			for (auto const& b : blocks) {
+				total += b.size();
+			}
+			return total;
+		}
+
+		GlyphArena(const GlyphArena&) = delete;
+		GlyphArena& operator=(const GlyphArena&) = delete;
+
+		GlyphArena(GlyphArena&&) = default;
+		GlyphArena& operator=(GlyphArena&&) = default;
+	private:
+		static constexpr uintptr_t MIN_BLOCK_SIZE = 16 * 1024;
+		static constexpr uintptr_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+		std::vector<HeapArray<unsigned char>> blocks;
+		uintptr_t used = 0; // Bytes used in blocks.back()
+		uintptr_t next_block_size = MIN_BLOCK_SIZE / 2;
+	};
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace SubPixelFonts {
+
+	// Strong references to recently used objects, so that objects only held by a WeakRegistry are not destroyed (and
+	// loaded again) as soon as their last user lets go of them. The least recently used objects are released when the
+	// total size is over the byte budget, and objects that have not been used for max_age are released by prune().
+	// Thread-safe. Released objects are destroyed after the cache is unlocked.
+
+	class KeepAliveCache {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// A budget of 0 (the default) keeps nothing alive. Releases anything that no longer fits.
+		void configure(size_t max_bytes_, Clock::duration max_age_) {
+			std::vector<std::shared_ptr<void>> released;
+			std::lock_guard<std::mutex> lock(mutex);
+
+			max_bytes = max_bytes_;
+			max_age = max_age_;
+			release(Clock::now(), released);
+		}
+
+		// Marks the object as just used. bytes is its current size, which can change between calls.
+		// Objects bigger than the whole budget are not kept.
+		void touch(std::shared_ptr<void> const& object, size_t bytes) {
+			std::vector<std::shared_ptr<void>> released;
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!max_bytes) {
+				return;
+			}
+
+			auto i = index.find(object.get());
+			if (bytes > max_bytes) {
+				// Releases it if it was kept while it was smaller
+				if (i != index.end()) {
+					total_bytes -= (*i).second->bytes;
+					released.push_back(std::move((*i).second->object));
+					entries.erase((*i).second);
+					index.erase(i);
+				}
+				return;
+			}
+
+			auto now = Clock::now();
+
+			if (i == index.end()) {
+				entries.push_front({ object, bytes, now });
+				index.emplace(object.get(), entries.begin());
+			}
+			else {
+				auto& entry = *(*i).second;
+				total_bytes -= entry.bytes;
+				entry.bytes = bytes;
+				entry.last_used = now;
+				entries.splice(entries.begin(), entries, (*i).second);
+			}
+			total_bytes += bytes;
+
+			release(now, released);
+		}
+
+		// Releases objects that have not been used for max_age. touch(..) only does this when it is called,
+		// so call this regularly (e.g. once per frame) for objects to be released on time.
+		void prune() {
+			std::vector<std::shared_ptr<void>> released;
+			std::lock_guard<std::mutex> lock(mutex);
+
+			release(Clock::now(), released);
+		}
+
+		void clear() {
+			std::list<Entry> released;
+			std::lock_guard<std::mutex> lock(mutex);
+
+			released.swap(entries);
+			index.clear();
+			total_bytes = 0;
+		}
+
+		size_t get_bytes() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return total_bytes;
+		}
+
+		size_t get_count() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return entries.size();
+		}
+	private:
+		struct Entry {
+			std::shared_ptr<void> object;
+			size_t bytes;
+			Clock::time_point last_used;
+		};
+
+		mutable std::mutex mutex;
+
+		std::list<Entry> entries; // Most recently used first
+		std::unordered_map<void const*, std::list<Entry>::iterator> index;
+		size_t total_bytes = 0;
+
+		size_t max_bytes = 0;
+		Clock::duration max_age = Clock::duration::zero();
+
+		// Moves the references to release into released so that the caller drops them after unlocking
+		void release(Clock::time_point now, std::vector<std::shared_ptr<void>>& released) {
+			while (!entries.empty() && (total_bytes > max_bytes || now - entries.back().last_used > max_age)) {
+				auto& entry = entries.back();
+				total_bytes -= entry.bytes;
+				index.erase(entry.object.get());
+				released.push_back(std::move(entry.object));
+				entries.pop_back();
+			}
+		}
+	};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <tuple>
+#include <cstdint>
+#include "Charset.h"
+
+namespace SubPixelFonts {
+
+	// Kerning between pairs of char codes in 1/64ths of a pixel. Pairs that are not in the table have no kerning.
+	// Pairs of ASCII characters are stored in a dense 128x128 array (only allocated if the font kerns any ASCII pairs),
+	// all other pairs are in a hash table.
+
+	class KerningTable {
+	public:
+		struct Pair {
+			CharCode left;
+			CharCode right;
+			int32_t x_64;
+		};
+
+		int32_t get(CharCode left, CharCode right) const {
+			if ((left | right) < ASCII_SIZE) {
+				return ascii.empty() ? 0 : ascii[left * ASCII_SIZE + right];
+			}
+
+			auto p = other.find(key(left, right));
+			return p == other.end() ? 0 : (*p).second;
+		}
+
+		// Setting a pair to 0 removes it
+		void set(CharCode left, CharCode right, int32_t x_64) {
+			if ((left | right) < ASCII_SIZE) {
+				if (ascii.empty()) {
+					if (!x_64) {
+						return;
+					}
+					ascii.resize(ASCII_SIZE * ASCII_SIZE);
+				}
+
+				auto& k = ascii[left * ASCII_SIZE + right];
+				ascii_pairs += (x_64 != 0) - (k != 0);
+				k = x_64;
+			}
+			else if (x_64) {
+				other[key(left, right)] = x_64;
+			}
+			else {
+				other.erase(key(left, right));
+			}
+		}
+
+		size_t size() const {
+			return ascii_pairs + other.size();
+		}
+
+		bool empty() const {
+			return size() == 0;
+		}
+
+		// All pairs sorted by left then right char code
+		std::vector<Pair> get_pairs() const {
+			std::vector<Pair> pairs;
+			pairs.reserve(size());
+
+			for (CharCode i = 0; i < ascii.size(); i++) {
+				if (ascii[i]) {
+					pairs.push_back({ i / ASCII_SIZE, i % ASCII_SIZE, ascii[i] });
+				}
+			}
+
+			for (auto const& [k, x_64] : other) {
+				pairs.push_back({ static_cast<CharCode>(k >> 32), static_cast<CharCode>(k), x_64 });
+			}
+
+			std::sort(pairs.begin(), pairs.end(), [](Pair const& a, Pair const& b) {
+				return std::tie(a.left, a.right) < std::tie(b.left, b.right);
+			});
+
+			return pairs;
+		}
+	private:
+		static constexpr CharCode ASCII_SIZE = 128;
+
+		std::vector<int32_t> ascii; // [left * 128 + right], empty if there are no ASCII pairs
+		size_t ascii_pairs = 0;
+
+		std::unordered_map<uint64_t, int32_t> other;
+
+		static uint64_t key(CharCode left, CharCode right) {
+			return (static_cast<uint64_t>(left) << 32) | right;
+		}
+	};
+}
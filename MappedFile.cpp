@@ -0,0 +1,104 @@
+#include "MappedFile.h"
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace SubPixelFonts {
+
+	static map<string, weak_ptr<MappedFile>> mapped_files;
+	static mutex mapped_files_mutex;
+
+	shared_ptr<MappedFile> MappedFile::open(string const& file_path) {
+		lock_guard<mutex> lock(mapped_files_mutex);
+
+		auto existing = mapped_files.find(file_path);
+
+		if (existing != mapped_files.end()) {
+			auto file = (*existing).second.lock();
+			if (file) {
+				return file;
+			}
+		}
+
+		auto file = make_shared<MappedFile>(file_path);
+		mapped_files.insert_or_assign(file_path, file);
+		return file;
+	}
+
+#ifdef _WIN32
+	MappedFile::MappedFile(string const& file_path) {
+		HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw runtime_error("Error opening file");
+		}
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+			CloseHandle(file);
+			throw runtime_error("Error opening file");
+		}
+
+		// The mapping keeps the file open
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+
+		if (!mapping) {
+			throw runtime_error("Error mapping file");
+		}
+
+		ptr = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!ptr) {
+			CloseHandle(mapping);
+			throw runtime_error("Error mapping file");
+		}
+
+		data_size = static_cast<size_t>(file_size.QuadPart);
+	}
+
+	MappedFile::~MappedFile() {
+		UnmapViewOfFile(ptr);
+		CloseHandle(mapping);
+	}
+#else
+	MappedFile::MappedFile(string const& file_path) {
+		int fd = ::open(file_path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw runtime_error("Error opening file");
+		}
+
+		struct stat s;
+		if (fstat(fd, &s) || s.st_size == 0) {
+			close(fd);
+			throw runtime_error("Error opening file");
+		}
+
+		// The mapping keeps the file open
+		void* p = mmap(nullptr, static_cast<size_t>(s.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (p == MAP_FAILED) {
+			throw runtime_error("Error mapping file");
+		}
+
+		ptr = static_cast<const unsigned char*>(p);
+		data_size = static_cast<size_t>(s.st_size);
+	}
+
+	MappedFile::~MappedFile() {
+		munmap(const_cast<unsigned char*>(ptr), data_size);
+	}
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstddef>
+
+namespace SubPixelFonts {
+
+	// Read-only memory mapping of a whole file.
+	// Mappings are shared: opening a file that is already mapped returns the existing mapping. open(..) is thread-safe.
+	// The operating system shares the pages between every process that maps the same file.
+
+	class MappedFile {
+	public:
+		// Throws std::runtime_error if the file cannot be opened or is empty
+		static std::shared_ptr<MappedFile> open(std::string const& file_path);
+
+		MappedFile(std::string const& file_path); // Do not call this. Use the static factory function open(..)
+		~MappedFile();
+
+		const unsigned char* data() const { return ptr; }
+		size_t size() const { return data_size; }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&&) = delete;
+		MappedFile& operator=(MappedFile&&) = delete;
+	private:
+		const unsigned char* ptr = nullptr;
+		size_t data_size = 0;
+
+#ifdef _WIN32
+		void* mapping = nullptr; // HANDLE
+#endif
+	};
+}
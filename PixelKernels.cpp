@@ -0,0 +1,570 @@
+#include "PixelKernels.h"
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define PIXEL_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// MSVC allows any intrinsic to be used without compiler flags, GCC and Clang need to be told per function
+#if defined(PIXEL_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+using namespace std;
+
+namespace SubPixelFonts {
+
+	// Plain C++
+
+	template <bool swap_red_blue>
+	static void rgb_to_rgba_scalar(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		for (size_t i = 0; i < pixels; i++) {
+			dst[0] = src[swap_red_blue ? 2 : 0];
+			dst[1] = src[1];
+			dst[2] = src[swap_red_blue ? 0 : 2];
+			dst[3] = 255;
+			dst += 4;
+			src += 3;
+		}
+	}
+
+	// Pixels are written 4 bytes at a time. The 4th byte is the first byte of the next pixel, which overwrites it,
+	// so the last pixel is written byte by byte.
+	static void rgba_to_rgb_scalar(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		if (!pixels) {
+			return;
+		}
+
+		for (size_t i = 0; i + 1 < pixels; i++) {
+			memcpy(dst, src, 4);
+			dst += 3;
+			src += 4;
+		}
+
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+	}
+
+	static void gray_to_rgba_scalar(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		for (size_t i = 0; i < pixels; i++) {
+			uint32_t gray = src[i] * 0x01010101u;
+			memcpy(dst, &gray, 4);
+			dst[3] = 255;
+			dst += 4;
+		}
+	}
+
+	// Same as rgba_to_rgb_scalar, the last pixel is written byte by byte
+	static void gray_to_rgb_scalar(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		if (!pixels) {
+			return;
+		}
+
+		for (size_t i = 0; i + 1 < pixels; i++) {
+			uint32_t gray = src[i] * 0x01010101u;
+			memcpy(dst, &gray, 4);
+			dst += 3;
+		}
+
+		dst[0] = dst[1] = dst[2] = src[pixels - 1];
+	}
+
+	static void apply_lut_scalar(unsigned char* data, size_t bytes, const unsigned char* lut) {
+		for (size_t i = 0; i < bytes; i++) {
+			data[i] = lut[data[i]];
+		}
+	}
+
+#ifdef PIXEL_KERNELS_X86
+
+	// Shuffle control for 4 RGB pixels (12 bytes) -> 4 RGBA pixels. Alpha bytes are zeroed (0x80) and or'd in later.
+	TARGET_SSSE3 static __m128i rgb_shuffle_mask(bool swap_red_blue) {
+		if (swap_red_blue) {
+			return _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+		}
+		return _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+	}
+
+	// 4 pixels. Reads 16 bytes so at least 6 pixels must be left in the source row.
+	TARGET_SSSE3 static inline void rgb_to_rgba_ssse3_4(unsigned char* dst, const unsigned char* src, __m128i mask, __m128i alpha) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+	}
+
+	// 16 pixels per iteration: 48 bytes in, 64 bytes out
+	template <bool swap_red_blue>
+	TARGET_SSSE3 static void rgb_to_rgba_ssse3(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		const __m128i mask = rgb_shuffle_mask(swap_red_blue);
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+
+			__m128i p0 = a;
+			__m128i p1 = _mm_alignr_epi8(b, a, 12);
+			__m128i p2 = _mm_alignr_epi8(c, b, 8);
+			__m128i p3 = _mm_srli_si128(c, 4);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(p0, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_shuffle_epi8(p1, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_shuffle_epi8(p2, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_or_si128(_mm_shuffle_epi8(p3, mask), alpha));
+
+			src += 48;
+			dst += 64;
+		}
+
+		for (; i + 6 <= pixels; i += 4) {
+			rgb_to_rgba_ssse3_4(dst, src, mask, alpha);
+			src += 12;
+			dst += 16;
+		}
+
+		rgb_to_rgba_scalar<swap_red_blue>(dst, src, pixels - i);
+	}
+
+	// 16 pixels per iteration: 64 bytes in, 48 bytes out
+	TARGET_SSSE3 static void rgba_to_rgb_ssse3(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		// Packs the RGB of 4 pixels into the low 12 bytes
+		const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), mask);
+			__m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), mask);
+			__m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), mask);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+
+			src += 64;
+			dst += 48;
+		}
+
+		rgba_to_rgb_scalar(dst, src, pixels - i);
+	}
+
+	// 16 pixels per iteration. Only needs SSE2 but is grouped with the SSSE3 functions for dispatch.
+	TARGET_SSSE3 static void gray_to_rgba_ssse3(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		const __m128i ones = _mm_set1_epi8(-1);
+
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+
+			__m128i gg_lo = _mm_unpacklo_epi8(g, g); // g0 g0 g1 g1 ..
+			__m128i gg_hi = _mm_unpackhi_epi8(g, g);
+			__m128i ga_lo = _mm_unpacklo_epi8(g, ones); // g0 255 g1 255 ..
+			__m128i ga_hi = _mm_unpackhi_epi8(g, ones);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(gg_lo, ga_lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(gg_lo, ga_lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi16(gg_hi, ga_hi));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi16(gg_hi, ga_hi));
+
+			src += 16;
+			dst += 64;
+		}
+
+		gray_to_rgba_scalar(dst, src, pixels - i);
+	}
+
+	// The table is split into 16 rows of 16 bytes and each row is looked up with a shuffle.
+	// Adding 0x70 with saturation to (byte - 16 * row) leaves the low 4 bits as the column for bytes in the row and
+	// sets the top bit (which makes the shuffle output 0) for all other bytes.
+	TARGET_SSSE3 static void apply_lut_ssse3(unsigned char* data, size_t bytes, const unsigned char* lut) {
+		__m128i rows[16];
+		for (int r = 0; r < 16; r++) {
+			rows[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + r * 16));
+		}
+
+		const __m128i row_size = _mm_set1_epi8(16);
+		const __m128i select = _mm_set1_epi8(0x70);
+
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16) {
+			__m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i result = _mm_setzero_si128();
+
+			for (int r = 0; r < 16; r++) {
+				result = _mm_or_si128(result, _mm_shuffle_epi8(rows[r], _mm_adds_epu8(index, select)));
+				index = _mm_sub_epi8(index, row_size);
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), result);
+		}
+
+		apply_lut_scalar(data + i, bytes - i, lut);
+	}
+
+	// Every row is looked up with the low 4 bits, then the high 4 bits pick the row with a tree of blends.
+	// Blends use the top bit of each byte, so each level shifts the bit it needs up to there.
+	TARGET_AVX2 static void apply_lut_avx2(unsigned char* data, size_t bytes, const unsigned char* lut) {
+		__m256i rows[16];
+		for (int r = 0; r < 16; r++) {
+			rows[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + r * 16)));
+		}
+
+		const __m256i low_bits = _mm256_set1_epi8(15);
+
+		size_t i = 0;
+		for (; i + 32 <= bytes; i += 32) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			__m256i column = _mm256_and_si256(v, low_bits);
+
+			__m256i bit4 = _mm256_slli_epi16(v, 3);
+			__m256i bit5 = _mm256_slli_epi16(v, 2);
+			__m256i bit6 = _mm256_slli_epi16(v, 1);
+
+			__m256i t[8];
+			for (int r = 0; r < 8; r++) {
+				t[r] = _mm256_blendv_epi8(_mm256_shuffle_epi8(rows[2 * r], column), _mm256_shuffle_epi8(rows[2 * r + 1], column), bit4);
+			}
+			for (int r = 0; r < 4; r++) {
+				t[r] = _mm256_blendv_epi8(t[2 * r], t[2 * r + 1], bit5);
+			}
+			for (int r = 0; r < 2; r++) {
+				t[r] = _mm256_blendv_epi8(t[2 * r], t[2 * r + 1], bit6);
+			}
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_blendv_epi8(t[0], t[1], v));
+		}
+
+		apply_lut_ssse3(data + i, bytes - i, lut);
+	}
+
+	// 8 pixels. Shuffles cannot cross the 128-bit lanes so each lane is loaded with its own
+	// 4 pixels: lane 0 from src[0..15] and lane 1 from src[12..27].
+	TARGET_AVX2 static inline void rgb_to_rgba_avx2_8(unsigned char* dst, const unsigned char* src, __m256i mask, __m256i alpha) {
+		__m256i v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12)), 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha));
+	}
+
+	// 16 pixels per iteration
+	template <bool swap_red_blue>
+	TARGET_AVX2 static void rgb_to_rgba_avx2(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		const __m256i mask = _mm256_broadcastsi128_si256(rgb_shuffle_mask(swap_red_blue));
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+
+		// The last load of each iteration reads 4 bytes past the 48 that are used, stop early enough
+		// that this stays within the source row
+		size_t i = 0;
+		for (; i + 18 <= pixels; i += 16) {
+			rgb_to_rgba_avx2_8(dst, src, mask, alpha);
+			rgb_to_rgba_avx2_8(dst + 32, src + 24, mask, alpha);
+
+			src += 48;
+			dst += 64;
+		}
+
+		// Glyph rows are often shorter than 16 pixels
+		if (i + 10 <= pixels) {
+			rgb_to_rgba_avx2_8(dst, src, mask, alpha);
+			i += 8;
+			src += 24;
+			dst += 32;
+		}
+		if (i + 6 <= pixels) {
+			rgb_to_rgba_ssse3_4(dst, src, _mm256_castsi256_si128(mask), _mm256_castsi256_si128(alpha));
+			i += 4;
+			src += 12;
+			dst += 16;
+		}
+
+		rgb_to_rgba_scalar<swap_red_blue>(dst, src, pixels - i);
+	}
+
+	static bool cpu_has_ssse3() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#else
+		return __builtin_cpu_supports("ssse3");
+#endif
+	}
+
+	static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+
+		// The OS must also save the YMM registers
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+#endif
+
+#ifdef PIXEL_KERNELS_NEON
+
+	template <bool swap_red_blue>
+	static void rgb_to_rgba_neon(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			uint8x16x3_t rgb = vld3q_u8(src);
+			uint8x16x4_t rgba;
+			rgba.val[0] = rgb.val[swap_red_blue ? 2 : 0];
+			rgba.val[1] = rgb.val[1];
+			rgba.val[2] = rgb.val[swap_red_blue ? 0 : 2];
+			rgba.val[3] = vdupq_n_u8(255);
+			vst4q_u8(dst, rgba);
+
+			src += 48;
+			dst += 64;
+		}
+
+		rgb_to_rgba_scalar<swap_red_blue>(dst, src, pixels - i);
+	}
+
+	static void rgba_to_rgb_neon(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			uint8x16x4_t rgba = vld4q_u8(src);
+			uint8x16x3_t rgb;
+			rgb.val[0] = rgba.val[0];
+			rgb.val[1] = rgba.val[1];
+			rgb.val[2] = rgba.val[2];
+			vst3q_u8(dst, rgb);
+
+			src += 64;
+			dst += 48;
+		}
+
+		rgba_to_rgb_scalar(dst, src, pixels - i);
+	}
+
+	static void gray_to_rgba_neon(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			uint8x16_t g = vld1q_u8(src);
+			uint8x16x4_t rgba;
+			rgba.val[0] = rgba.val[1] = rgba.val[2] = g;
+			rgba.val[3] = vdupq_n_u8(255);
+			vst4q_u8(dst, rgba);
+
+			src += 16;
+			dst += 64;
+		}
+
+		gray_to_rgba_scalar(dst, src, pixels - i);
+	}
+
+	static void gray_to_rgb_neon(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			uint8x16_t g = vld1q_u8(src);
+			uint8x16x3_t rgb;
+			rgb.val[0] = rgb.val[1] = rgb.val[2] = g;
+			vst3q_u8(dst, rgb);
+
+			src += 16;
+			dst += 48;
+		}
+
+		gray_to_rgb_scalar(dst, src, pixels - i);
+	}
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+	// Table lookups of 64 bytes give 0 for indices past the end, so each quarter of the table only matches its own bytes
+	static void apply_lut_neon(unsigned char* data, size_t bytes, const unsigned char* lut) {
+		uint8x16x4_t quarters[4];
+		for (int q = 0; q < 4; q++) {
+			quarters[q] = vld1q_u8_x4(lut + q * 64);
+		}
+
+		const uint8x16_t quarter_size = vdupq_n_u8(64);
+
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16) {
+			uint8x16_t index = vld1q_u8(data + i);
+			uint8x16_t result = vqtbl4q_u8(quarters[0], index);
+
+			for (int q = 1; q < 4; q++) {
+				index = vsubq_u8(index, quarter_size);
+				result = vorrq_u8(result, vqtbl4q_u8(quarters[q], index));
+			}
+
+			vst1q_u8(data + i, result);
+		}
+
+		apply_lut_scalar(data + i, bytes - i, lut);
+	}
+#endif
+
+#endif
+
+	using ConvertFunction = void (*)(unsigned char*, const unsigned char*, size_t);
+	using LutFunction = void (*)(unsigned char*, size_t, const unsigned char*);
+
+	struct PixelKernels {
+		const char* name = "scalar";
+		ConvertFunction rgb_to_rgba = rgb_to_rgba_scalar<false>;
+		ConvertFunction bgr_to_rgba = rgb_to_rgba_scalar<true>;
+		ConvertFunction rgba_to_rgb = rgba_to_rgb_scalar;
+		ConvertFunction gray_to_rgba = gray_to_rgba_scalar;
+		ConvertFunction gray_to_rgb = gray_to_rgb_scalar;
+		LutFunction apply_lut = apply_lut_scalar;
+
+		PixelKernels() {
+#ifdef PIXEL_KERNELS_X86
+			if (cpu_has_avx2()) {
+				name = "avx2";
+				rgb_to_rgba = rgb_to_rgba_avx2<false>;
+				bgr_to_rgba = rgb_to_rgba_avx2<true>;
+				rgba_to_rgb = rgba_to_rgb_ssse3;
+				gray_to_rgba = gray_to_rgba_ssse3;
+				apply_lut = apply_lut_avx2;
+			}
+			else if (cpu_has_ssse3()) {
+				name = "ssse3";
+				rgb_to_rgba = rgb_to_rgba_ssse3<false>;
+				bgr_to_rgba = rgb_to_rgba_ssse3<true>;
+				rgba_to_rgb = rgba_to_rgb_ssse3;
+				gray_to_rgba = gray_to_rgba_ssse3;
+				apply_lut = apply_lut_ssse3;
+			}
+#endif
+#ifdef PIXEL_KERNELS_NEON
+			name = "neon";
+			rgb_to_rgba = rgb_to_rgba_neon<false>;
+			bgr_to_rgba = rgb_to_rgba_neon<true>;
+			rgba_to_rgb = rgba_to_rgb_neon;
+			gray_to_rgba = gray_to_rgba_neon;
+			gray_to_rgb = gray_to_rgb_neon;
+#if defined(__aarch64__) || defined(_M_ARM64)
+			apply_lut = apply_lut_neon;
+#endif
+#endif
+		}
+	};
+
+	// Initialised on first use (thread safe)
+	static PixelKernels const& get_kernels() {
+		static const PixelKernels kernels;
+		return kernels;
+	}
+
+	// Rows of small glyphs are shorter than one iteration of these vector loops, and the indirect call and setup
+	// cost more than they save, so they use the plain loops. rgb_to_rgba has vector code for short rows.
+	static const size_t SHORT_ROW_PIXELS = 16;
+	static const size_t SHORT_LUT_BYTES = 1024;
+	static const size_t SHORT_BLIT_BYTES = 64;
+
+	void rgb_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		get_kernels().rgb_to_rgba(dst, src, pixels);
+	}
+
+	void bgr_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		get_kernels().bgr_to_rgba(dst, src, pixels);
+	}
+
+	void rgba_to_rgb(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		if (pixels < SHORT_ROW_PIXELS) {
+			rgba_to_rgb_scalar(dst, src, pixels);
+			return;
+		}
+		get_kernels().rgba_to_rgb(dst, src, pixels);
+	}
+
+	void gray_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		if (pixels < SHORT_ROW_PIXELS) {
+			gray_to_rgba_scalar(dst, src, pixels);
+			return;
+		}
+		get_kernels().gray_to_rgba(dst, src, pixels);
+	}
+
+	void gray_to_rgb(unsigned char* dst, const unsigned char* src, size_t pixels) {
+		if (pixels < SHORT_ROW_PIXELS) {
+			gray_to_rgb_scalar(dst, src, pixels);
+			return;
+		}
+		get_kernels().gray_to_rgb(dst, src, pixels);
+	}
+
+	void apply_lut(unsigned char* data, size_t bytes, const unsigned char* lut) {
+		if (bytes < SHORT_LUT_BYTES) {
+			apply_lut_scalar(data, bytes, lut);
+			return;
+		}
+		get_kernels().apply_lut(data, bytes, lut);
+	}
+
+	// Fixed size copies are inlined, which is quicker than calling memcpy for a few bytes.
+	// Rows of 8 bytes or more end with a copy that overlaps the previous one.
+	static inline void copy_short_row(unsigned char* dst, const unsigned char* src, size_t bytes) {
+		if (bytes < 8) {
+			for (size_t i = 0; i < bytes; i++) {
+				dst[i] = src[i];
+			}
+			return;
+		}
+
+		for (size_t i = 0; i + 8 < bytes; i += 8) {
+			memcpy(dst + i, src + i, 8);
+		}
+		memcpy(dst + bytes - 8, src + bytes - 8, 8);
+	}
+
+	void blit_rows(unsigned char* dst, size_t dst_stride, const unsigned char* src, size_t src_stride,
+		size_t row_bytes, size_t rows)
+	{
+		if (dst_stride == row_bytes && src_stride == row_bytes) {
+			memcpy(dst, src, row_bytes * rows);
+			return;
+		}
+
+		if (row_bytes < SHORT_BLIT_BYTES) {
+			for (size_t y = 0; y < rows; y++) {
+				copy_short_row(dst, src, row_bytes);
+				dst += dst_stride;
+				src += src_stride;
+			}
+			return;
+		}
+
+		for (size_t y = 0; y < rows; y++) {
+			memcpy(dst, src, row_bytes);
+			dst += dst_stride;
+			src += src_stride;
+		}
+	}
+
+	const char* get_pixel_kernels_name() {
+		return get_kernels().name;
+	}
+
+}
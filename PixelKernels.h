@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+namespace SubPixelFonts {
+
+	// Pixel conversion functions used when creating glyph bitmaps and texture atlases.
+	// The fastest implementation supported by the CPU (AVX2, SSSE3, NEON, or plain C++) is picked the first time
+	// one of these is called.
+
+	// Packed 8-bit RGB -> RGBA with alpha = 255. dst and src must not overlap.
+	void rgb_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels);
+
+	// Packed 8-bit BGR -> RGBA with alpha = 255 (red and blue swapped). dst and src must not overlap.
+	void bgr_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels);
+
+	// RGBA -> packed 8-bit RGB, alpha is discarded. dst and src must not overlap.
+	void rgba_to_rgb(unsigned char* dst, const unsigned char* src, size_t pixels);
+
+	// 8-bit grayscale -> RGBA with the value copied to red, green and blue and alpha = 255
+	void gray_to_rgba(unsigned char* dst, const unsigned char* src, size_t pixels);
+
+	// 8-bit grayscale -> packed RGB with the value copied to all three channels
+	void gray_to_rgb(unsigned char* dst, const unsigned char* src, size_t pixels);
+
+	// Replaces every byte with lut[byte], in place. lut has 256 entries.
+	void apply_lut(unsigned char* data, size_t bytes, const unsigned char* lut);
+
+	// Copies a rectangle of bytes between two images with different row strides.
+	// Rows are copied with memcpy, which the C library implements with the widest vector instructions available,
+	// so this does not need its own versions for each instruction set. Short rows use inlined 8-byte copies instead.
+	void blit_rows(unsigned char* dst, size_t dst_stride, const unsigned char* src, size_t src_stride,
+		size_t row_bytes, size_t rows);
+
+	// Name of the instruction set used by the functions above, e.g. "avx2"
+	const char* get_pixel_kernels_name();
+
+}
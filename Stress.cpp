@@ -0,0 +1,108 @@
+#include "Font.h"
+#include "TextureAtlas.h"
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <cstring>
+
+using namespace std;
+using namespace SubPixelFonts;
+
+// Loads fonts, font instances and cached texture atlases from many threads at once and checks the results.
+// Mixes eager, lazy, multi-threaded and memory mapped loads with glyph lookups, texture atlas creation and
+// cached texture atlas loads. Build with 'make stress', ideally with -fsanitize=thread.
+// Usage: stress [font files...] (default Lato-Regular.ttf Lato-Bold.ttf)
+
+static const unsigned int THREADS = 16;
+static const unsigned int ITERATIONS = 60;
+
+int main(int argc, char** argv) {
+	vector<string> paths;
+	for (int i = 1; i < argc; i++) {
+		paths.push_back(argv[i]);
+	}
+	if (paths.empty()) {
+		paths = { "Lato-Regular.ttf", "Lato-Bold.ttf" };
+	}
+
+	Font::init();
+
+	atomic<unsigned int> failures{ 0 };
+	{
+		// A texture atlas to load from the cache, kept in memory so that no image library is needed
+		auto cached_font = Font::load(paths[0])->load_font_instance(14);
+		TextureAtlas reference(256, 256, { cached_font });
+
+		vector<vector<unsigned char>> images;
+		for (auto const& image : reference.get_image_data()) {
+			images.emplace_back(image.get(), image.get() + image.size());
+		}
+		string csv = reference.get_glyph_data(0);
+
+		auto reference_glyph = reference.get_glyph_map(0).find('A');
+		if (!reference_glyph) {
+			cerr << "Reference font has no glyph for 'A'\n";
+			return 1;
+		}
+		unsigned int reference_x = reference_glyph->bitmap_x, reference_y = reference_glyph->bitmap_y;
+
+		vector<thread> threads;
+		for (unsigned int t = 0; t < THREADS; t++) {
+			threads.emplace_back([&, t]() {
+				try {
+					for (unsigned int i = 0; i < ITERATIONS; i++) {
+						auto font = Font::load(paths[(t + i) % paths.size()], true, (i & 1) != 0);
+
+						FontInstanceOptions options;
+						options.lazy = i % 3 == 0;
+						options.threads = i % 5 == 0 ? 2 : 1;
+						options.subpixel_phases = i % 4 == 0 ? 3 : 1;
+						auto font_instance = font->load_font_instance(10 + i % 4, true, options);
+
+						for (CharCode c = 32; c < 256; c += 1 + t % 3) {
+							for (unsigned int phase = 0; phase < options.subpixel_phases; phase++) {
+								auto glyph = font_instance->get_glyph(c, phase);
+								if (glyph && glyph->get_bitmap_size_bytes() && !glyph->bitmap_data) {
+									failures++;
+								}
+							}
+						}
+
+						if (i % 7 == 0) {
+							TextureAtlas::ImageVector copy;
+							for (auto const& image : images) {
+								HeapArray<unsigned char> c(image.size());
+								memcpy(c.get(), image.data(), image.size());
+								copy.push_back(move(c));
+							}
+
+							TextureAtlas cached(256, 256, move(copy), { { paths[0], 14, csv } });
+							auto glyph = cached.get_glyph_map(0).find('A');
+							if (!glyph || glyph->bitmap_x != reference_x || glyph->bitmap_y != reference_y) {
+								failures++;
+							}
+						}
+
+						if (i % 11 == 0) {
+							TextureAtlas atlas(256, 256, { font_instance });
+						}
+					}
+				}
+				catch (exception const& e) {
+					cerr << "Exception: " << e.what() << '\n';
+					failures++;
+				}
+			});
+		}
+
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+	Font::deinit();
+
+	cout << THREADS << " threads x " << ITERATIONS << " iterations, " << failures << " failures\n";
+	return failures ? 1 : 0;
+}
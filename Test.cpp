@@ -14,7 +14,7 @@ using namespace std;
 using namespace SubPixelFonts;
 
 
-const auto fonts_to_load = vector<pair<string, FontHeight>>{
+const auto fonts_to_load = vector<pair<string, FontSize>>{
 {
 	"Lato-Regular.ttf", 32
 },
@@ -34,7 +34,7 @@ auto load_fonts() {
 	return vector<shared_ptr<FontInstance>> {
 		lato->load_font_instance(32), lato->load_font_instance(16), lato_bold->load_font_instance(16)
 	};
-	// lato and lato_bold get deleted. that is fine.
+	// Only the keep-alive cache keeps lato and lato_bold now. That is fine.
 }
 
 void show_opengl_window(TextureAtlas& atlas);
@@ -42,6 +42,9 @@ void show_opengl_window(TextureAtlas& atlas);
 void example() {
 	Font::init();
 
+	// Keep recently used fonts and font instances loaded after load_fonts() lets go of them
+	Font::set_keep_alive(32 * 1024 * 1024, chrono::minutes(1));
+
 	TextureAtlas* atlas = nullptr;
 
 	try {
@@ -133,13 +136,27 @@ void show_opengl_window(TextureAtlas& atlas) {
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
 
-	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, atlas.get_width(), atlas.get_height(), static_cast<GLsizei>(atlas.get_image_data().size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	GLenum internal_format = GL_RGBA8;
+	GLenum pixel_format = GL_RGBA;
+
+	if (atlas.get_pixel_format() == PixelFormat::RGB8) {
+		internal_format = GL_RGB8;
+		pixel_format = GL_RGB;
+	}
+	else if (atlas.get_pixel_format() == PixelFormat::R8) {
+		internal_format = GL_R8;
+		pixel_format = GL_RED;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, atlas.get_width(), atlas.get_height(), static_cast<GLsizei>(atlas.get_image_data().size()), 0, pixel_format, GL_UNSIGNED_BYTE, nullptr);
 
 	{ // Upload data
 		unsigned int i = 0;
 		for (const auto& img : atlas.get_image_data()) {
-			assert_(img.size() == atlas.get_width() * atlas.get_height() * 4);
-			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, atlas.get_width(), atlas.get_height(), 1, GL_RGBA, GL_UNSIGNED_BYTE, img.get());
+			assert_(img.size() == atlas.get_width() * atlas.get_height() * get_bytes_per_pixel(atlas.get_pixel_format()));
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, atlas.get_width(), atlas.get_height(), 1, pixel_format, GL_UNSIGNED_BYTE, img.get());
 
 			i++;
 		}
@@ -162,7 +179,7 @@ void show_opengl_window(TextureAtlas& atlas) {
 
 
 	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-	src = FONT_FRAGMENT_SHADER_GL3;
+	src = atlas.get_pixel_format() == PixelFormat::R8 ? FONT_FRAGMENT_SHADER_GRAYSCALE_GL3 : FONT_FRAGMENT_SHADER_GL3;
 	glShaderSource(fs, 1, &src, nullptr);
 	glCompileShader(fs);
 	glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
@@ -249,24 +266,30 @@ void show_opengl_window(TextureAtlas& atlas) {
 		int x = 10;
 		int y = i*200 + 80;
 
+		auto const& font = atlas.get_font_instance(i);
+		CharCode previous = 0;
+
 		for (char c : text1[i]) {
+			x += (font->get_kerning(previous, static_cast<CharCode>(c)) + 32) >> 6;
+			previous = static_cast<CharCode>(c);
+
 			auto const& glyph_map = atlas.get_glyph_map(i);
-			auto iter = glyph_map.find(static_cast<CharCode>(c));
+			auto atlas_glyph_ptr = glyph_map.find(static_cast<CharCode>(c));
 
-			if (iter == glyph_map.end()) {
+			if (!atlas_glyph_ptr) {
 				// Whitespace character?
 
 				auto const& glyph_map2 = atlas.get_font_glyph_map(i);
-				auto iter2 = glyph_map2.find(static_cast<CharCode>(c));
+				auto glyph_ptr = glyph_map2.find(static_cast<CharCode>(c));
 
-				if (iter2 != glyph_map2.end()) {
-					x += (*iter2).second.advance;
+				if (glyph_ptr) {
+					x += glyph_ptr->advance;
 				}
 
 				continue;
 			}
 
-			auto const& atlas_glyph = (*iter).second;
+			auto const& atlas_glyph = *atlas_glyph_ptr;
 			auto const& glyph = *atlas_glyph.glyph;
 
 			x += glyph.left;
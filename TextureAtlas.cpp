@@ -1,9 +1,14 @@
 #include "TextureAtlas.h"
 #include <stb_rect_pack.h>
 #include "Assert.h"
+#include "PixelKernels.h"
 #include <sstream>
 #include <fstream>
 #include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <shared_mutex>
+#include <charconv>
 
 #ifdef STB_IMAGE_AVAILABLE
 #include <stb_image.h>
@@ -17,20 +22,175 @@ using namespace std;
 
 namespace SubPixelFonts {
 
-	TextureAtlas::TextureAtlas(unsigned int w, unsigned int h, vector<shared_ptr<FontInstance>> const& fonts, bool clear_background)
-		: width(w), height(h)
+	static const char* pixel_format_name(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::RGB8:
+			return "rgb8";
+		case PixelFormat::R8:
+			return "r8";
+		default:
+			return "rgba8";
+		}
+	}
+
+	static PixelFormat pixel_format_from_name(string const& name) {
+		if (name == "rgb8") {
+			return PixelFormat::RGB8;
+		}
+		if (name == "rgba8") {
+			return PixelFormat::RGBA8;
+		}
+		if (name == "r8") {
+			return PixelFormat::R8;
+		}
+		throw runtime_error("Unknown pixel format in texture atlas cache CSV file");
+	}
+
+	static const char* render_mode_name(RenderMode mode) {
+		switch (mode) {
+		case RenderMode::Grayscale:
+			return "grayscale";
+		case RenderMode::SDF:
+			return "sdf";
+		default:
+			return "lcd";
+		}
+	}
+
+	static RenderMode render_mode_from_name(string const& name) {
+		if (name == "grayscale") {
+			return RenderMode::Grayscale;
+		}
+		if (name == "lcd") {
+			return RenderMode::LCD;
+		}
+		if (name == "sdf") {
+			return RenderMode::SDF;
+		}
+		throw runtime_error("Unknown render mode in texture atlas cache CSV file");
+	}
+
+	// Shortest string that reads back as exactly the same value, so font instances loaded from the cache
+	// are cached under the same options as the ones that were saved
+	static string double_to_string(double value) {
+		char buffer[32];
+		auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+		return string(buffer, result.ptr);
+	}
+
+	// Variable font axes are written as "tag:value;tag:value"
+	static string variation_to_string(map<string, double> const& variation) {
+		string s;
+		for (auto const& [tag, value] : variation) {
+			if (!s.empty()) {
+				s += ';';
+			}
+			s += tag + ':' + double_to_string(value);
+		}
+		return s;
+	}
+
+	static map<string, double> variation_from_string(string const& str) {
+		map<string, double> variation;
+		istringstream s(str);
+		string axis;
+
+		while (getline(s, axis, ';')) {
+			auto colon = axis.find(':');
+			if (colon == string::npos) {
+				throw runtime_error("Invalid variation in texture atlas cache CSV file");
+			}
+			variation[axis.substr(0, colon)] = stod(axis.substr(colon + 1));
+		}
+		return variation;
+	}
+
+	// Copies a glyph bitmap into an atlas image, converting it to the pixel format of the atlas
+	static void copy_glyph_bitmap(unsigned char* dst, unsigned int dst_width_pixels, PixelFormat dst_format, Glyph const& glyph) {
+		const unsigned char* src = glyph.bitmap_data;
+
+		auto dst_bpp = get_bytes_per_pixel(dst_format);
+		auto src_bpp = get_bytes_per_pixel(glyph.format);
+
+		if (glyph.format == dst_format) {
+			blit_rows(dst, dst_width_pixels * dst_bpp, src, glyph.bitmap_width * src_bpp, glyph.bitmap_width * src_bpp, glyph.bitmap_height);
+			return;
+		}
+
+		// Grayscale coverage is copied to all 3 channels so that it can be drawn with the LCD shader
+		using Convert = void (*)(unsigned char*, const unsigned char*, size_t);
+		Convert convert;
+
+		if (glyph.format == PixelFormat::R8) {
+			convert = dst_format == PixelFormat::RGBA8 ? gray_to_rgba : gray_to_rgb;
+		}
+		else if (dst_format == PixelFormat::RGBA8) {
+			convert = rgb_to_rgba;
+		}
+		else if (dst_format == PixelFormat::RGB8) {
+			convert = rgba_to_rgb;
+		}
+		else {
+			throw runtime_error("LCD glyphs cannot be stored in an R8 texture atlas");
+		}
+
+		for (unsigned y = 0; y < glyph.bitmap_height; y++) {
+			convert(dst, src, glyph.bitmap_width);
+
+			dst += dst_width_pixels * dst_bpp;
+			src += glyph.bitmap_width * src_bpp;
+		}
+	}
+
+	// Copies an R8 glyph bitmap into one channel of an atlas image. dst points at that channel of the top left pixel.
+	static void copy_glyph_to_channel(unsigned char* dst, unsigned int dst_width_pixels, unsigned int dst_bpp, Glyph const& glyph) {
+		const unsigned char* src = glyph.bitmap_data;
+
+		for (unsigned y = 0; y < glyph.bitmap_height; y++) {
+			for (unsigned x = 0; x < glyph.bitmap_width; x++) {
+				dst[x * dst_bpp] = src[x];
+			}
+
+			dst += dst_width_pixels * dst_bpp;
+			src += glyph.bitmap_width;
+		}
+	}
+
+	TextureAtlas::TextureAtlas(unsigned int w, unsigned int h, vector<shared_ptr<FontInstance>> const& fonts, bool clear_background,
+		PixelFormat format_, bool pack_channels_)
+		: width(w), height(h), format(format_), pack_channels(pack_channels_)
 	{
+		const unsigned int bpp = get_bytes_per_pixel(format);
 
 		// Count glyphs
 
+		// Lazy font instances can get new glyphs from other threads. Stop that while their glyphs are being listed.
+		// Glyphs do not move so the bitmaps can be copied after unlocking.
+		vector<shared_lock<shared_mutex>> locks;
+
 		size_t glyphsTotal = 0;
 		{
 			for (auto const& fi : fonts) {
+				// The same font instance can be in the vector twice
+				bool locked = false;
+				for (auto const& other : all_glyph_data) {
+					locked = locked || other.font == fi;
+				}
+				if (!locked) {
+					locks.emplace_back(fi->glyphs_mutex);
+				}
+
 				if (fi->data_freed) {
 					throw runtime_error("Font data has been freed");
 				}
 
-				glyphsTotal += fi->glyphs.size();
+				if (pack_channels && fi->options.get_glyph_pixel_format() != PixelFormat::R8) {
+					throw runtime_error("Only grayscale glyphs can be packed into separate channels");
+				}
+
+				for (auto const& phase_glyphs : fi->glyphs) {
+					glyphsTotal += phase_glyphs.size();
+				}
 
 				all_glyph_data.emplace_back(fi);
 			}
@@ -44,37 +204,49 @@ namespace SubPixelFonts {
 
 		vector<stbrp_rect> rects;
 		vector<AtlasGlyph*> id_to_glyph;
+
+		stbrp_rect white_pixel_rect;
+		white_pixel_rect.id = -1;
+		white_pixel_rect.w = 1;
+		white_pixel_rect.h = 1;
+
 		{
 			rects.reserve(glyphsTotal + 1);
 			id_to_glyph.reserve(glyphsTotal);
 
-			stbrp_rect r;
-			r.id = -1;
-			r.w = 1;
-			r.h = 1;
-			rects.push_back(r);
+			// When packing channels the white pixel has to be reserved in every channel, so it is packed separately
+			if (!pack_channels) {
+				rects.push_back(white_pixel_rect);
+			}
 
 			for (auto& font_instance_data : all_glyph_data) {
-				for (const auto& [char_code, glyph] : font_instance_data.font->glyphs) {
-					// Create atlas glyph object
-					auto& atlas_glyph = (*font_instance_data.map.insert(pair<CharCode, AtlasGlyph>(char_code, AtlasGlyph(&glyph))).first).second;
+				for (size_t phase = 0; phase < font_instance_data.maps.size(); phase++) {
+					for (const auto& [char_code, glyph] : font_instance_data.font->glyphs[phase]) {
+						// Create atlas glyph object
+						auto& atlas_glyph = font_instance_data.maps[phase].emplace(char_code, &glyph);
 
-					if (glyph.bitmap_width && glyph.bitmap_height) {
+						if (glyph.bitmap_width && glyph.bitmap_height) {
 
-						// Store reference to it in rect.id->glyph array
-						id_to_glyph.push_back(&atlas_glyph);
+							// Store reference to it in rect.id->glyph array
+							id_to_glyph.push_back(&atlas_glyph);
 
 
-						stbrp_rect r;
-						r.id = static_cast<int>(id_to_glyph.size() - 1);
-						r.w = glyph.bitmap_width;
-						r.h = glyph.bitmap_height;
-						rects.push_back(r);
+							stbrp_rect r;
+							r.id = static_cast<int>(id_to_glyph.size() - 1);
+							r.w = glyph.bitmap_width;
+							r.h = glyph.bitmap_height;
+							rects.push_back(r);
+						}
 					}
 				}
 			}
 		}
 
+		locks.clear();
+
+
+		// Each channel of a layer is packed like a separate R8 image
+		const unsigned int channels = pack_channels ? bpp : 1;
 
 		bool all_packed = false;
 		vector<stbrp_node> nodes(width);
@@ -83,7 +255,7 @@ namespace SubPixelFonts {
 		while (!all_packed) {
 			// New layer
 
-			images.push_back(HeapArray<unsigned char>(width * height * 4));
+			images.push_back(HeapArray<unsigned char>(width * height * bpp));
 			layers++;
 			auto const& this_layer_image = images[images.size() - 1];
 
@@ -91,59 +263,74 @@ namespace SubPixelFonts {
 				memset(this_layer_image.get(), 0, this_layer_image.size());
 			}
 
+			for (unsigned int channel = 0; channel < channels && !all_packed; channel++) {
 
-			// Pack as many as possible
+				// Pack as many as possible
 
-			stbrp_init_target(&context, width, height, nodes.data(), static_cast<int>(nodes.size()));
-			all_packed = stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size())) != 0;
+				stbrp_init_target(&context, width, height, nodes.data(), static_cast<int>(nodes.size()));
 
-			// Put all the unpacked rects into rects2 and create glyph objects for the packed ones
+				if (pack_channels && layers == 1) {
+					// The first rectangle packed into an empty target always goes at 0,0
+					stbrp_pack_rects(&context, &white_pixel_rect, 1);
+					assert_(white_pixel_rect.was_packed && white_pixel_rect.x == 0 && white_pixel_rect.y == 0);
 
-			vector<stbrp_rect> rects2;
+					white_pixel_layer = white_pixel_x = white_pixel_y = 0;
+					memset(this_layer_image.get(), 255, bpp);
+				}
 
-			if (!all_packed) {
-				rects2.reserve(rects.size());
-			}
+				all_packed = stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size())) != 0;
 
-			for (auto const& rect : rects) {
-				if (rect.was_packed) {
-					if (rect.id == -1) {
-						white_pixel_layer = static_cast<unsigned>(images.size()) - 1;
-						white_pixel_x = rect.x;
-						white_pixel_y = rect.y;
+				// Put all the unpacked rects into rects2 and create glyph objects for the packed ones
 
-						unsigned char* dst = &this_layer_image.get()[(white_pixel_y * width + white_pixel_x) * 4];
-						dst[0] = dst[1] = dst[2] = 255;
-					}
-					else {
-						// Create glyph object
+				vector<stbrp_rect> rects2;
 
-						AtlasGlyph& atlas_glyph = *id_to_glyph[rect.id];
-						atlas_glyph.bitmap_layer = static_cast<unsigned>(images.size()) - 1;
-						atlas_glyph.bitmap_x = rect.x;
-						atlas_glyph.bitmap_y = rect.y;
+				if (!all_packed) {
+					rects2.reserve(rects.size());
+				}
+
+				for (auto const& rect : rects) {
+					if (rect.was_packed) {
+						if (rect.id == -1) {
+							white_pixel_layer = static_cast<unsigned>(images.size()) - 1;
+							white_pixel_x = rect.x;
+							white_pixel_y = rect.y;
+
+							unsigned char* dst = &this_layer_image.get()[(white_pixel_y * width + white_pixel_x) * bpp];
+							memset(dst, 255, bpp);
+						}
+						else {
+							// Create glyph object
 
-						Glyph const& glyph = *atlas_glyph.glyph;
+							AtlasGlyph& atlas_glyph = *id_to_glyph[rect.id];
+							atlas_glyph.bitmap_layer = static_cast<unsigned>(images.size()) - 1;
+							atlas_glyph.bitmap_x = rect.x;
+							atlas_glyph.bitmap_y = rect.y;
+							atlas_glyph.bitmap_channel = channel;
 
-						unsigned char* dst = this_layer_image.get();
-						unsigned char* src = glyph.bitmap_data.value().get();
+							Glyph const& glyph = *atlas_glyph.glyph;
 
-						assert_(atlas_glyph.bitmap_y + glyph.bitmap_height <= height);
-						assert_(atlas_glyph.bitmap_x + glyph.bitmap_width <= width);
+							unsigned char* dst = this_layer_image.get();
 
-						for (unsigned y = 0; y < glyph.bitmap_height; y++) {
-							unsigned dst_idx = ((y + atlas_glyph.bitmap_y) * width + (atlas_glyph.bitmap_x)) * 4;
+							assert_(atlas_glyph.bitmap_y + glyph.bitmap_height <= height);
+							assert_(atlas_glyph.bitmap_x + glyph.bitmap_width <= width);
 
-							memcpy(&dst[dst_idx], &src[y * glyph.bitmap_width * 4], glyph.bitmap_width * 4);
+							unsigned dst_idx = (atlas_glyph.bitmap_y * width + atlas_glyph.bitmap_x) * bpp;
+
+							if (pack_channels) {
+								copy_glyph_to_channel(&dst[dst_idx + channel], width, bpp, glyph);
+							}
+							else {
+								copy_glyph_bitmap(&dst[dst_idx], width, format, glyph);
+							}
 						}
 					}
+					else {
+						rects2.push_back(rect);
+					}
 				}
-				else {
-					rects2.push_back(rect);
-				}
-			}
 
-			rects = move(rects2);
+				rects = move(rects2);
+			}
 		}
 
 
@@ -153,24 +340,102 @@ namespace SubPixelFonts {
 		const auto& font_data = all_glyph_data[font_index];
 
 		ostringstream s;
-		s << "charcode,bitmap_x,bitmap_y,bitmap_layer,advance,bitmap_width,bitmap_height,left,top\n";
+
+		// Metadata lines are only written for non-default settings so that older versions can still read the file
+
+		if (format != PixelFormat::RGBA8) {
+			s << "#pixel_format=" << pixel_format_name(format) << '\n';
+		}
+
+		auto const& options = font_data.font->get_options();
+
+		if (options.render_mode != RenderMode::LCD) {
+			s << "#render_mode=" << render_mode_name(options.render_mode) << '\n';
+		}
+
+		// Needed to draw the distance field, so it is written even if it is the default
+		if (options.render_mode == RenderMode::SDF) {
+			s << "#sdf_spread=" << to_string(options.sdf_spread) << '\n';
+		}
+
+		if (!options.variation.empty()) {
+			s << "#variation=" << variation_to_string(options.variation) << '\n';
+		}
+
+		if (options.synthetic_bold) {
+			s << "#synthetic_bold=1\n";
+		}
+
+		if (options.has_coverage_curve()) {
+			s << "#gamma=" << double_to_string(options.gamma) << '\n';
+			s << "#contrast=" << double_to_string(options.contrast) << '\n';
+		}
+
+		if (options.synthetic_oblique) {
+			s << "#synthetic_oblique=1\n";
+		}
+
+		bool phases = options.subpixel_phases > 1;
+
+		if (phases) {
+			s << "#subpixel_phases=" << to_string(options.subpixel_phases) << '\n';
+		}
+
+		// Columns after "top" are optional
+
+		s << "charcode,bitmap_x,bitmap_y,bitmap_layer,advance,bitmap_width,bitmap_height,left,top";
+		if (pack_channels) {
+			s << ",bitmap_channel";
+		}
+		if (phases) {
+			s << ",phase,advance_64";
+		}
+		s << '\n';
+
 		s << "0," << to_string(white_pixel_x) << ',' << to_string(white_pixel_y) << ',' << to_string(white_pixel_layer)
-			<< ",0,1,1,0,0\n";
+			<< ",0,1,1,0,0";
+		if (pack_channels) {
+			s << ",0";
+		}
+		if (phases) {
+			s << ",0,0";
+		}
+		s << '\n';
+
+
+		for (unsigned int phase = 0; phase < font_data.maps.size(); phase++) {
+			for (const auto& [char_code, atlas_glyph] : font_data.maps[phase]) {
+				const auto& glyph = *atlas_glyph.glyph;
+
+				s << to_string(char_code)
+					<< ',' << to_string(atlas_glyph.bitmap_x)
+					<< ',' << to_string(atlas_glyph.bitmap_y)
+					<< ',' << to_string(atlas_glyph.bitmap_layer)
+					<< ',' << to_string(glyph.advance)
+					<< ',' << to_string(glyph.bitmap_width)
+					<< ',' << to_string(glyph.bitmap_height)
+					<< ',' << to_string(glyph.left)
+					<< ',' << to_string(glyph.top);
+				if (pack_channels) {
+					s << ',' << to_string(atlas_glyph.bitmap_channel);
+				}
+				if (phases) {
+					s << ',' << to_string(phase) << ',' << to_string(glyph.advance_64);
+				}
+				s << '\n';
+			}
+		}
 
+		// Kerning pairs follow the glyphs after an empty line
 
-		for (const auto& [char_code, atlas_glyph] : font_data.map) {
-			const auto& glyph = *atlas_glyph.glyph;
+		auto const& kerning = font_data.font->get_kerning_table();
 
-			s << to_string(char_code)
-				<< ',' << to_string(atlas_glyph.bitmap_x)
-				<< ',' << to_string(atlas_glyph.bitmap_y)
-				<< ',' << to_string(atlas_glyph.bitmap_layer)
-				<< ',' << to_string(glyph.advance)
-				<< ',' << to_string(glyph.bitmap_width)
-				<< ',' << to_string(glyph.bitmap_height)
-				<< ',' << to_string(glyph.left)
-				<< ',' << to_string(glyph.top)
-				<< '\n';
+		if (!kerning.empty()) {
+			s << "\nleft,right,x_64\n";
+
+			for (auto const& pair : kerning.get_pairs()) {
+				s << to_string(pair.left) << ',' << to_string(pair.right) << ',' << to_string(pair.x_64) << '\n';
+			}
 		}
 
 		return s.str();
@@ -190,102 +455,240 @@ namespace SubPixelFonts {
 		do_init(move(fonts));
 	}
 
-	void TextureAtlas::do_init(vector<CachedFontData>&& fonts)
-	{
-		for (auto const& font : fonts) {
-			auto font_ptr = Font::load(font.path, false);
-			auto font_instance_ptr = font_ptr->load_font_instance(font.height, false);
+	// Cache CSV files can start with lines of the form "#name=value" that describe how the glyphs were generated.
+	// Reads those lines and leaves the first line that is not metadata (the column names) in line.
+	static map<string, string> read_metadata(istream& s, string& line) {
+		map<string, string> metadata;
 
-			all_glyph_data.emplace_back(font_instance_ptr);
+		while (getline(s, line)) {
+			if (!line.empty() && line[line.size() - 1] == '\r') {
+				line.pop_back();
+			}
 
-			auto& font_data = all_glyph_data[all_glyph_data.size() - 1];
+			if (line.empty() || line[0] != '#') {
+				return metadata;
+			}
 
+			auto equals = line.find('=');
+			if (equals == string::npos) {
+				throw runtime_error("Invalid texture atlas cache CSV file");
+			}
+
+			metadata[line.substr(1, equals - 1)] = line.substr(equals + 1);
+		}
+
+		line.clear();
+		return metadata;
+	}
+
+	static PixelFormat read_pixel_format(map<string, string> const& metadata) {
+		auto f = metadata.find("pixel_format");
+		return f == metadata.end() ? PixelFormat::RGBA8 : pixel_format_from_name((*f).second);
+	}
 
+	static vector<string> split_csv_line(string const& line) {
+		vector<string> values;
+		istringstream s(!line.empty() && line[line.size() - 1] == '\r' ? line.substr(0, line.size() - 1) : line);
+		string value;
 
+		while (getline(s, value, ',')) {
+			values.push_back(move(value));
+		}
 
+		return values;
+	}
+
+	// Every cache CSV file starts with these columns
+	static const char* const REQUIRED_COLUMNS[] = { "charcode", "bitmap_x", "bitmap_y", "bitmap_layer", "advance",
+		"bitmap_width", "bitmap_height", "left", "top" };
+
+	void TextureAtlas::do_init(vector<CachedFontData>&& fonts)
+	{
+		bool first_font = true;
+
+		for (auto const& font : fonts) {
 			istringstream s(font.glyph_data);
 
 			const char* const EXCEPTION_INVALID_CSV = "Invalid texture atlas cache CSV file";
 
-			const char* const first_line = "charcode,bitmap_x,bitmap_y,bitmap_layer,advance,bitmap_width,bitmap_height,left,top";
-
 			string line;
-			if (!getline(s, line) || line.rfind(first_line, 0) != 0) {
+			auto metadata = read_metadata(s, line);
+
+			auto columns = split_csv_line(line);
+
+			if (columns.size() < size(REQUIRED_COLUMNS) || !equal(begin(REQUIRED_COLUMNS), end(REQUIRED_COLUMNS), columns.begin())) {
 				throw runtime_error(EXCEPTION_INVALID_CSV);
 			}
 
-			if (line.size() != strlen(first_line) && line.size() != strlen(first_line) + 1 && line[line.size() - 1] != '\r') {
-				throw runtime_error(EXCEPTION_INVALID_CSV);
+			// Columns added by later versions are ignored
+			auto find_column = [&columns](const char* name) -> optional<size_t> {
+				auto c = find(columns.begin(), columns.end(), name);
+				return c == columns.end() ? nullopt : optional<size_t>(c - columns.begin());
+			};
+
+			auto channel_column = find_column("bitmap_channel");
+			auto phase_column = find_column("phase");
+			auto advance_64_column = find_column("advance_64");
+
+			if (first_font) {
+				pack_channels = channel_column.has_value();
+			}
+			else if (pack_channels != channel_column.has_value()) {
+				throw runtime_error("Texture atlas cache CSV files disagree about channel packing");
 			}
 
+			// All fonts in the atlas share the same images
+			auto font_format = read_pixel_format(metadata);
+			if (first_font) {
+				format = font_format;
+				first_font = false;
+			}
+			else if (font_format != format) {
+				throw runtime_error("Texture atlas cache CSV files have different pixel formats");
+			}
+
+			// The font instance is cached under the options it was generated with
+			FontInstanceOptions options;
+
+			auto render_mode = metadata.find("render_mode");
+			if (render_mode != metadata.end()) {
+				options.render_mode = render_mode_from_name((*render_mode).second);
+			}
+
+			auto sdf_spread = metadata.find("sdf_spread");
+			if (sdf_spread != metadata.end()) {
+				options.sdf_spread = stoi((*sdf_spread).second);
+
+				if (options.sdf_spread < 2 || options.sdf_spread > 32) {
+					throw runtime_error(EXCEPTION_INVALID_CSV);
+				}
+			}
+
+			auto variation = metadata.find("variation");
+			if (variation != metadata.end()) {
+				options.variation = variation_from_string((*variation).second);
+			}
+
+			options.synthetic_bold = metadata.count("synthetic_bold") && metadata.at("synthetic_bold") == "1";
+			options.synthetic_oblique = metadata.count("synthetic_oblique") && metadata.at("synthetic_oblique") == "1";
+
+			auto gamma = metadata.find("gamma");
+			if (gamma != metadata.end()) {
+				options.gamma = stod((*gamma).second);
+			}
+
+			auto contrast = metadata.find("contrast");
+			if (contrast != metadata.end()) {
+				options.contrast = stod((*contrast).second);
+			}
+
+			auto subpixel_phases = metadata.find("subpixel_phases");
+			if (subpixel_phases != metadata.end()) {
+				options.subpixel_phases = stoi((*subpixel_phases).second);
+
+				if (options.subpixel_phases < 1 || options.subpixel_phases > 64) {
+					throw runtime_error(EXCEPTION_INVALID_CSV);
+				}
+			}
+
+			auto font_ptr = Font::load(font.path, false);
+			auto font_instance_ptr = font_ptr->load_font_instance(font.size, false, options);
+
+			all_glyph_data.emplace_back(font_instance_ptr);
+
+			auto& font_data = all_glyph_data[all_glyph_data.size() - 1];
+
+			// Other threads might be loading cached texture atlases that use the same font instance
+			unique_lock<shared_mutex> lock(font_instance_ptr->glyphs_mutex);
+
+
+			bool has_kerning = false;
 
 			while (getline(s, line)) {
-				istringstream ss(line);
+				auto values = split_csv_line(line);
+
+				if (values.empty()) {
+					has_kerning = true;
+					break;
+				}
 
-				string value;
+				if (values.size() != columns.size()) {
+					throw runtime_error(EXCEPTION_INVALID_CSV);
+				}
 
-				auto next = [&ss, &value, EXCEPTION_INVALID_CSV]() {
-					if (!getline(ss, value, ',')) {
-						throw runtime_error(EXCEPTION_INVALID_CSV);
-					}
+				auto value = [&values](size_t column) {
+					return stoi(values[column]);
 				};
 
-				next();
-				CharCode char_code = stoi(value);
+				CharCode char_code = value(0);
 
 				if (char_code == 0) {
-					next();
-					white_pixel_x = stoi(value);
-
-					next();
-					white_pixel_y = stoi(value);
-
-					next();
-					white_pixel_layer = stoi(value);
-					next();
-					next();
-					next();
-					next();
-					next();
+					white_pixel_x = value(1);
+					white_pixel_y = value(2);
+					white_pixel_layer = value(3);
 				}
 				else {
-					auto& glyph = (*font_instance_ptr->glyphs.insert(pair<CharCode, Glyph>(char_code, Glyph())).first).second;
+					unsigned int phase = phase_column ? value(*phase_column) : 0;
 
-					auto& atlas_glyph = (*font_data.map.insert(pair<CharCode, AtlasGlyph>(char_code, AtlasGlyph(&glyph))).first).second;
-					atlas_glyph.glyph = &glyph;
+					if (phase >= options.subpixel_phases) {
+						throw runtime_error("Glyph subpixel phase out of range");
+					}
 
-					next();
-					atlas_glyph.bitmap_x = stoi(value);
+					auto& glyph = font_instance_ptr->glyphs[phase].emplace(char_code);
 
-					next();
-					atlas_glyph.bitmap_y = stoi(value);
+					auto& atlas_glyph = font_data.maps[phase].emplace(char_code, &glyph);
+					atlas_glyph.glyph = &glyph;
 
-					next();
-					atlas_glyph.bitmap_layer = stoi(value);
+					atlas_glyph.bitmap_x = value(1);
+					atlas_glyph.bitmap_y = value(2);
+					atlas_glyph.bitmap_layer = value(3);
 
 					if (atlas_glyph.bitmap_layer >= images.size()) {
 						throw runtime_error("Glyph bitmap layer out of range");
 					}
 
-					next();
-					glyph.advance = stoi(value);
+					glyph.advance = value(4);
+					glyph.bitmap_width = value(5);
+					glyph.bitmap_height = value(6);
+					glyph.left = value(7);
+					glyph.top = value(8);
 
-					next();
-					glyph.bitmap_width = stoi(value);
+					glyph.advance_64 = advance_64_column ? value(*advance_64_column) : glyph.advance * 64;
 
-					next();
-					glyph.bitmap_height = stoi(value);
+					if (channel_column) {
+						atlas_glyph.bitmap_channel = value(*channel_column);
 
-					next();
-					glyph.left = stoi(value);
+						if (atlas_glyph.bitmap_channel >= get_bytes_per_pixel(format)) {
+							throw runtime_error("Glyph bitmap channel out of range");
+						}
+					}
+				}
+			}
 
-					next();
-					glyph.top = stoi(value);
+			if (has_kerning) {
+				if (!getline(s, line) || split_csv_line(line) != vector<string>{ "left", "right", "x_64" }) {
+					throw runtime_error(EXCEPTION_INVALID_CSV);
+				}
+
+				while (getline(s, line)) {
+					auto values = split_csv_line(line);
+
+					if (values.size() != 3) {
+						throw runtime_error(EXCEPTION_INVALID_CSV);
+					}
+
+					font_instance_ptr->kerning.set(stoi(values[0]), stoi(values[1]), stoi(values[2]));
 				}
 			}
 		}
 
+		layers = static_cast<unsigned>(images.size());
 
+		for (auto const& image : images) {
+			if (image.size() != static_cast<uintptr_t>(width) * height * get_bytes_per_pixel(format)) {
+				throw runtime_error("Texture atlas image is the wrong size");
+			}
+		}
 	}
 
 	static HeapArray<unsigned char> load_file(ifstream& in) {
@@ -310,10 +713,39 @@ namespace SubPixelFonts {
 
 #if defined(LIB_WEBP_AVAILABLE) || defined(STB_IMAGE_AVAILABLE)
 	TextureAtlas::TextureAtlas(unsigned int w, unsigned int h, string const& image_file_path_no_suffix,
-		string const& csv_file_path_no_suffix, vector<pair<string, FontHeight>>&& fonts)
+		string const& csv_file_path_no_suffix, vector<pair<string, FontSize>>&& fonts)
 		: width(w), height(h)
 	{
 
+		vector<CachedFontData> font_data;
+
+		unsigned int i = 0;
+		for (auto& f : fonts) {
+			CachedFontData fd;
+			fd.path = move(f.first);
+			fd.size = f.second;
+
+			ifstream fs(csv_file_path_no_suffix + to_string(i++) + string(".csv"), ios::in | ios::binary);
+			if (!fs.good()) {
+				throw runtime_error("Missing .csv file");
+			}
+
+			fd.glyph_data = load_file_str(fs);
+
+			font_data.push_back(move(fd));
+
+		}
+
+		// The csv files say what format the images are in
+		if (!font_data.empty()) {
+			istringstream s(font_data[0].glyph_data);
+			string line;
+			format = read_pixel_format(read_metadata(s, line));
+		}
+		const unsigned int bpp = get_bytes_per_pixel(format);
+
+
+
 		while (1) {
 #ifdef LIB_WEBP_AVAILABLE
 			ifstream f_webp(image_file_path_no_suffix + to_string(images.size()) + string(".webp"), ios::in | ios::binary);
@@ -333,13 +765,29 @@ namespace SubPixelFonts {
 					throw runtime_error("Webp is wrong size");
 				}
 
-				uint8_t* decoded_data = WebPDecodeRGBA(data.get(), data.size(), &actual_width, &actual_height);
+				uint8_t* decoded_data = format == PixelFormat::RGBA8
+					? WebPDecodeRGBA(data.get(), data.size(), &actual_width, &actual_height)
+					: WebPDecodeRGB(data.get(), data.size(), &actual_width, &actual_height);
 
 				if (!decoded_data) {
 					throw runtime_error("Invalid Webp file");
 				}
 
-				images.push_back(HeapArray<unsigned char>(decoded_data, width * height * 4, [](unsigned char* p) {
+				if (format == PixelFormat::R8) {
+					// Saved as RGB, keep the red channel
+					HeapArray<unsigned char> gray(static_cast<uintptr_t>(width) * height);
+					for (uintptr_t j = 0; j < gray.size(); j++) {
+						gray.get()[j] = decoded_data[j * 3];
+					}
+					WebPFree(decoded_data);
+
+					images.push_back(move(gray));
+					layers++;
+
+					continue;
+				}
+
+				images.push_back(HeapArray<unsigned char>(decoded_data, width * height * bpp, [](unsigned char* p) {
 					WebPFree(p);
 				}));
 				layers++;
@@ -353,7 +801,7 @@ namespace SubPixelFonts {
 				auto data = load_file(f_png);
 				int actual_width, actual_height;
 				int channels_in_file;
-				uint8_t* decoded_data = stbi_load_from_memory(data.get(), static_cast<int>(data.size()), &actual_width, &actual_height, &channels_in_file, 4);
+				uint8_t* decoded_data = stbi_load_from_memory(data.get(), static_cast<int>(data.size()), &actual_width, &actual_height, &channels_in_file, static_cast<int>(bpp));
 
 				if (!decoded_data) {
 					throw runtime_error("Invalid PNG file");
@@ -363,7 +811,7 @@ namespace SubPixelFonts {
 					throw runtime_error("PNG is wrong size");
 				}
 
-				images.push_back(HeapArray<unsigned char>(decoded_data, width * height * 4, [](unsigned char* p) {
+				images.push_back(HeapArray<unsigned char>(decoded_data, width * height * bpp, [](unsigned char* p) {
 					stbi_image_free(p);
 				}));
 				layers++;
@@ -379,25 +827,6 @@ namespace SubPixelFonts {
 			throw runtime_error("No images found");
 		}
 
-		vector<CachedFontData> font_data;
-
-		unsigned int i = 0;
-		for (auto& f : fonts) {
-			CachedFontData fd;
-			fd.path = move(f.first);
-			fd.height = f.second;
-
-			ifstream fs(csv_file_path_no_suffix + to_string(i++) + string(".csv"), ios::in | ios::binary);
-			if (!fs.good()) {
-				throw runtime_error("Missing .csv file");
-			}
-
-			fd.glyph_data = load_file_str(fs);
-
-			font_data.push_back(move(fd));
-
-		}
-
 
 
 		do_init(move(font_data));
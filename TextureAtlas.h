@@ -18,6 +18,7 @@
 #ifdef LIB_WEBP_AVAILABLE
 #include <webp/encode.h>
 #include <fstream>
+#include "PixelKernels.h"
 #endif
 
 
@@ -31,6 +32,9 @@ namespace SubPixelFonts {
 		unsigned int bitmap_y = 0;
 		unsigned bitmap_layer = 0;
 
+		// Colour channel (0 = red .. 3 = alpha) that holds the glyph in channel packed texture atlases, otherwise 0
+		unsigned bitmap_channel = 0;
+
 		// Pointer is set in TextureAtlas constructor. Pointer has same lifetime as font object (TextureAtlas::FontInstanceData::font)
 		const Glyph* glyph;
 
@@ -43,27 +47,33 @@ namespace SubPixelFonts {
 
 
 		// If clear_background is false then all unused space in the texture is uninitialised and might not compress well if exported to a .png
-		TextureAtlas(unsigned int width, unsigned int height, std::vector<std::shared_ptr<FontInstance>> const&, bool clear_background = true);
+		// Glyphs are converted to the pixel format of the atlas if they were rendered in a different one
+		// If pack_channels is true then every colour channel of the images is packed with a different set of grayscale glyphs,
+		// fitting 3 (RGB8) or 4 (RGBA8) times as many glyphs in each layer. Only grayscale font instances can be used.
+		// Draw with FONT_VERTEX_SHADER_CHANNEL_PACKED_GL3 and FONT_FRAGMENT_SHADER_CHANNEL_PACKED_GL3.
+		TextureAtlas(unsigned int width, unsigned int height, std::vector<std::shared_ptr<FontInstance>> const&, bool clear_background = true,
+			PixelFormat = PixelFormat::RGBA8, bool pack_channels = false);
 
 		struct CachedFontData {
 			std::string path;
-			FontHeight height;
+			FontSize size;
 			std::string glyph_data; // Contents of .csv file
 		};
 
 		// Fonts don't get loaded, but if they haven't been loaded in yet then they will be initialised from the glyph csv file
 		// Load cachced texture atlases after loading any fonts in the regular way
+		// The pixel format of the images is read from the csv data
 		TextureAtlas(unsigned int width, unsigned int height, ImageVector&&, std::vector<CachedFontData>&& fonts);
 
 #if defined(LIB_WEBP_AVAILABLE) || defined(STB_IMAGE_AVAILABLE)
 		TextureAtlas(unsigned int width, unsigned int height, std::string const& image_file_path_no_suffix,
-			std::string const& csv_file_path_no_suffix, std::vector<std::pair<std::string, FontHeight>>&&);
+			std::string const& csv_file_path_no_suffix, std::vector<std::pair<std::string, FontSize>>&&);
 #endif
 
 
 		//TextureAtlas(unsigned int width, unsigned int height, ImageVector&&, std::vector<std::shared_ptr<FontInstance>> const&);
 
-		AtlasGlyph const& get_glyph_position(std::shared_ptr<FontInstance> const&, FontHeight, CharCode);
+		AtlasGlyph const& get_glyph_position(std::shared_ptr<FontInstance> const&, FontSize, CharCode);
 
 		// Returns string containing text representation of all glyphs (including position in the bitmap)
 		std::string get_glyph_data(unsigned int font_index);
@@ -81,7 +91,8 @@ namespace SubPixelFonts {
 		void save_png(std::string const& file_path_without_suffix) {
 			unsigned int i = 0;
 			for (const auto& image : images) {
-				if (!stbi_write_png((file_path_without_suffix + std::to_string(i) + std::string(".png")).c_str(), width, height, 4, image.get(), width * 4)) {
+				int channels = static_cast<int>(get_bytes_per_pixel(format));
+				if (!stbi_write_png((file_path_without_suffix + std::to_string(i) + std::string(".png")).c_str(), width, height, channels, image.get(), width * channels)) {
 					throw std::runtime_error("stb_image_write error");
 				}
 
@@ -95,7 +106,19 @@ namespace SubPixelFonts {
 			unsigned int i = 0;
 			for (const auto& image : images) {
 				uint8_t* out;
-				auto size = WebPEncodeLosslessRGBA(image.get(), width, height, width * 4, &out);
+				size_t size;
+
+				if (format == PixelFormat::R8) {
+					// WebP has no single channel format
+					HeapArray<unsigned char> rgb(static_cast<uintptr_t>(width) * height * 3);
+					gray_to_rgb(rgb.get(), image.get(), static_cast<uintptr_t>(width) * height);
+					size = WebPEncodeLosslessRGB(rgb.get(), width, height, width * 3, &out);
+				}
+				else {
+					size = format == PixelFormat::RGB8
+						? WebPEncodeLosslessRGB(image.get(), width, height, width * 3, &out)
+						: WebPEncodeLosslessRGBA(image.get(), width, height, width * 4, &out);
+				}
 				if (!size) {
 					throw std::runtime_error("libwebp error");
 				}
@@ -117,39 +140,61 @@ namespace SubPixelFonts {
 		unsigned int get_width() const { return width; }
 		unsigned int get_height() const { return height; }
 		unsigned int get_layers() const { return layers; }
+		PixelFormat get_pixel_format() const { return format; }
+		bool is_channel_packed() const { return pack_channels; }
 
 		void free_data() {
 			images = ImageVector();
 		}
 
-		std::map<CharCode, AtlasGlyph> const& get_glyph_map(unsigned int font_index) {
-			return all_glyph_data[font_index].map;
+		// For kerning (FontInstance::get_kerning(..))
+		std::shared_ptr<FontInstance> const& get_font_instance(unsigned int font_index) {
+			return all_glyph_data[font_index].font;
 		}
 
-		std::map<CharCode, Glyph> const& get_font_glyph_map(unsigned int font_index) {
-			return all_glyph_data[font_index].font->glyphs;
+		// phase is the subpixel phase (see FontInstanceOptions::subpixel_phases)
+
+		CodepointTable<AtlasGlyph> const& get_glyph_map(unsigned int font_index, unsigned int phase = 0) {
+			return all_glyph_data[font_index].maps.at(phase);
+		}
+
+		CodepointTable<Glyph> const& get_font_glyph_map(unsigned int font_index, unsigned int phase = 0) {
+			return all_glyph_data[font_index].get_glyphs(phase);
 		}
 
 
 
-		std::map<CharCode, AtlasGlyph> const& get_glyph_map(FontInstance const& font) {
+		CodepointTable<AtlasGlyph> const& get_glyph_map(FontInstance const& font, unsigned int phase = 0) {
 			for (const auto& f : all_glyph_data) {
 				if (f.font.get() == &font) {
-					return f.map;
+					return f.maps.at(phase);
 				}
 			}
 			throw std::runtime_error("Font instance not found");
 		}
 
-		std::map<CharCode, Glyph> const& get_font_glyph_map(FontInstance const& font) {
+		CodepointTable<Glyph> const& get_font_glyph_map(FontInstance const& font, unsigned int phase = 0) {
 			for (const auto& f : all_glyph_data) {
 				if (f.font.get() == &font) {
-					return f.font->glyphs;
+					return f.get_glyphs(phase);
 				}
 			}
 			throw std::runtime_error("Font instance not found");
 		}
 
+		// True if the glyphs of a font instance have been replaced since the atlas was made, e.g. the full quality glyphs of
+		// a progressive font instance (FontInstanceOptions::progressive) are ready. The atlas keeps using the old glyphs.
+		// Make a new texture atlas with the same font instances to use the new glyphs.
+		bool is_outdated() const {
+			for (auto const& f : all_glyph_data) {
+				if (f.font->get_glyphs_version() != f.glyphs_version) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// The white pixel is 255 in every channel
 		unsigned int white_px_x() {
 			return white_pixel_x;
 		}
@@ -163,14 +208,30 @@ namespace SubPixelFonts {
 		}
 
 	private:
-		unsigned int width, height, layers;
+		unsigned int width, height, layers = 0;
+		PixelFormat format = PixelFormat::RGBA8;
+		bool pack_channels = false;
 
 		struct FontInstanceData {
 			std::shared_ptr<FontInstance> font; // AtlasGlyphs rely on this shared pointer keeping the FontInstance alive
-			std::map<CharCode, AtlasGlyph> map;
+			std::vector<CodepointTable<AtlasGlyph>> maps; // [subpixel phase]
+
+			// The font instance's glyph maps when the atlas was made. They stay in memory if the font instance replaces them.
+			// The font instance must be locked when this is created.
+			CodepointTable<Glyph> const* glyphs;
+			unsigned int glyphs_version;
 
-			FontInstanceData(std::shared_ptr<FontInstance> const& f) : font(f) {}
-			FontInstanceData(std::shared_ptr<FontInstance>&& f) : font(move(f)) {}
+			FontInstanceData(std::shared_ptr<FontInstance> const& f)
+				: font(f), maps(f->get_options().subpixel_phases), glyphs(f->glyphs.data()), glyphs_version(f->get_glyphs_version()) {}
+			FontInstanceData(std::shared_ptr<FontInstance>&& f)
+				: font(move(f)), maps(font->get_options().subpixel_phases), glyphs(font->glyphs.data()), glyphs_version(font->get_glyphs_version()) {}
+
+			CodepointTable<Glyph> const& get_glyphs(unsigned int phase) const {
+				if (phase >= maps.size()) {
+					throw std::out_of_range("Invalid subpixel phase");
+				}
+				return glyphs[phase];
+			}
 		};
 
 		std::vector<FontInstanceData> all_glyph_data;
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <iterator>
+#include <mutex>
+#include <shared_mutex>
+#include <future>
+
+namespace SubPixelFonts {
+
+	// Thread-safe cache of weak pointers. Objects stay in the registry for as long as something else keeps them alive.
+	// Lookups of live objects only take a shared lock so they can happen in parallel, and objects are created unlocked.
+	// Entries of destroyed objects are removed whenever an object is created, so the map does not keep growing.
+
+	template <typename Key, typename T>
+	class WeakRegistry {
+	public:
+		// Returns the object for key if it is alive and reuse(object) returns true, otherwise creates it with create().
+		// create() is called without the registry locked, so other keys can be looked up and created while it runs.
+		// Each object is only created once: threads that ask for a key that is being created wait for it.
+		// create() must not ask this registry for the same key.
+		template <typename Create, typename Reuse>
+		std::shared_ptr<T> get_or_create(Key const& key, Create create, Reuse reuse) {
+			{
+				std::shared_lock<std::shared_mutex> lock(mutex);
+
+				auto existing = find(key);
+				if (existing && reuse(existing)) {
+					return existing;
+				}
+			}
+
+			std::unique_lock<std::shared_mutex> lock(mutex);
+
+			for (;;) {
+				// Another thread might have created it while this one was waiting for the lock
+				auto existing = find(key);
+				if (existing && reuse(existing)) {
+					return existing;
+				}
+
+				auto p = pending.find(key);
+				if (p == pending.end()) {
+					break;
+				}
+
+				// Wait for the other thread without the lock, then check again in case the object cannot be reused
+				auto creating = (*p).second;
+				lock.unlock();
+				existing = nullptr;
+				creating.wait();
+				lock.lock();
+			}
+
+			std::promise<std::shared_ptr<T>> promise;
+			pending.emplace(key, promise.get_future().share());
+			lock.unlock();
+
+			std::shared_ptr<T> object;
+			try {
+				object = create();
+			}
+			catch (...) {
+				// Threads that were waiting try to create it themselves
+				lock.lock();
+				pending.erase(key);
+				lock.unlock();
+				promise.set_value(nullptr);
+				throw;
+			}
+
+			lock.lock();
+
+			prune();
+
+			// Destroy the replaced object after unlocking in case its destructor uses the registry
+			std::shared_ptr<T> replaced;
+			auto o = objects.find(key);
+			if (o != objects.end()) {
+				replaced = (*o).second.lock();
+				(*o).second = object;
+			}
+			else {
+				objects.emplace(key, object);
+			}
+
+			pending.erase(key);
+			lock.unlock();
+
+			promise.set_value(object);
+			return object;
+		}
+
+		template <typename Create>
+		std::shared_ptr<T> get_or_create(Key const& key, Create create) {
+			return get_or_create(key, create, [](std::shared_ptr<T> const&) { return true; });
+		}
+	private:
+		std::shared_mutex mutex;
+		std::map<Key, std::weak_ptr<T>> objects;
+		std::map<Key, std::shared_future<std::shared_ptr<T>>> pending; // Objects being created
+
+		void prune() {
+			for (auto o = objects.begin(); o != objects.end();) {
+				o = (*o).second.expired() ? objects.erase(o) : std::next(o);
+			}
+		}
+
+		std::shared_ptr<T> find(Key const& key) const {
+			auto o = objects.find(key);
+			return o == objects.end() ? nullptr : (*o).second.lock();
+		}
+	};
+}